@@ -0,0 +1,422 @@
+/*******************************************************************************
+ * Fittsmenu selection simulator
+ *
+ *   Drives the toolkit independent core with a synthetic user and reports
+ *   how long selections take and how often they go wrong, over a sweep of
+ *   slice counts, radii and animation modes. Nothing is drawn and no display
+ *   is needed, configurations run in parallel on every processor.
+ *
+ *   The user moves along minimum jerk paths timed by Fitts' law, aiming for
+ *   the middle of the target slice as the ring is drawn when the movement
+ *   starts. Endpoints scatter with the spread Fitts' law implies for the
+ *   target's width, plus a bias to overshoot. After each movement the user
+ *   looks to see whether the target is highlighted and corrects if not, an
+ *   expert sometimes clicks straight after the first movement without
+ *   looking. Clicks select whatever the core hit tests, frame lag included.
+ *
+ *   ISCALE and PULSE only change how the ring is drawn, not where anything
+ *   is, so they predict the same as no animation. They are kept in the
+ *   sweep as a control.
+ *
+ *   Results are CSV on stdout, one line per configuration, times over all
+ *   trials, correct or not.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "fittsmenu-core.h"
+
+/* Seconds spent looking whether the target lit up before correcting */
+#define SIM_VERIFY_TIME 0.15
+
+/* The user gives up and clicks after this many movements */
+#define SIM_MAX_MOVEMENTS 4
+
+/* Distances below this are not worth a movement */
+#define SIM_MIN_AMPLITUDE 0.5
+
+/* The user and the input device, shared by every configuration */
+typedef struct
+{
+  gdouble  fitts_a;       // Seconds
+  gdouble  fitts_b;       // Seconds per bit
+  gdouble  overshoot;     // Mean overshoot as a fraction of the distance
+  gdouble  ballistic;     // Chance of clicking without looking
+  gint     rate;          // Pointer samples per second
+  gint     frame_interval; // Milliseconds between pointer updates the core applies
+  gint     trials;
+  guint32  seed;
+} SimModel;
+
+/* One configuration and what became of it */
+typedef struct
+{
+  guint    index;
+  gint     n_slices;
+  gint     radius;
+  gint     inner_radius;
+  gint     animation;
+
+  gdouble  mean_ms;
+  gdouble  sd_ms;
+  gdouble  error_rate;
+  gdouble  movements;
+} SimJob;
+
+static const gchar *animation_names[] = { "none", "crotate", "iscale", "pulse" };
+
+static SimModel model;
+
+static void sim_run (gpointer data, gpointer user_data);
+static gint64 sim_move (FittsmenuCore *core, gdouble *x, gdouble *y, gdouble to_x,
+                        gdouble to_y, gdouble duration, gint64 time);
+static gint64 sim_pause (FittsmenuCore *core, gdouble x, gdouble y, gdouble duration,
+                         gint64 time);
+static void sim_aim (FittsmenuCore *core, gint index, gdouble *x, gdouble *y);
+static gdouble sim_width (FittsmenuCore *core, gint index);
+static gdouble gauss (GRand *rand);
+static gint* parse_ints (const gchar *list, gint *n);
+static gint* parse_animations (const gchar *list, gint *n);
+
+int
+main (int argc, char **argv)
+{
+  gchar *slices_opt = "4,8,12,16,24";
+  gchar *radius_opt = "100,120,160";
+  gchar *inner_opt = "40,80";
+  gchar *animation_opt = "none,crotate,iscale";
+  gint threads = 0;
+  GOptionEntry entries[] =
+  {
+    { "slices", 's', 0, G_OPTION_ARG_STRING, &slices_opt, "Slice counts to sweep", "N,..." },
+    { "radius", 'r', 0, G_OPTION_ARG_STRING, &radius_opt, "Menu radii to sweep", "PX,..." },
+    { "inner-radius", 'i', 0, G_OPTION_ARG_STRING, &inner_opt, "Inner radii to sweep", "PX,..." },
+    { "animation", 'm', 0, G_OPTION_ARG_STRING, &animation_opt,
+      "Animation modes to sweep, none, crotate, iscale or pulse", "MODE,..." },
+    { "trials", 't', 0, G_OPTION_ARG_INT, &model.trials, "Selections per configuration", "N" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, &model.seed, "Random seed", "N" },
+    { "threads", 'j', 0, G_OPTION_ARG_INT, &threads, "Worker threads, default one per processor", "N" },
+    { "fitts-a", 0, 0, G_OPTION_ARG_DOUBLE, &model.fitts_a, "Fitts' law intercept in seconds", "S" },
+    { "fitts-b", 0, 0, G_OPTION_ARG_DOUBLE, &model.fitts_b, "Fitts' law slope in seconds per bit", "S" },
+    { "overshoot", 0, 0, G_OPTION_ARG_DOUBLE, &model.overshoot,
+      "Mean overshoot as a fraction of the distance", "F" },
+    { "ballistic", 0, 0, G_OPTION_ARG_DOUBLE, &model.ballistic,
+      "Chance of clicking without checking the highlight", "P" },
+    { "rate", 0, 0, G_OPTION_ARG_INT, &model.rate, "Pointer samples per second", "HZ" },
+    { "frame-interval", 0, 0, G_OPTION_ARG_INT, &model.frame_interval,
+      "Milliseconds between pointer updates the menu applies", "MS" },
+    { NULL }
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  GThreadPool *pool;
+  SimJob *jobs;
+  gint *slices, *radii, *inners, *animations;
+  gint n_slices, n_radii, n_inners, n_animations;
+  gint s, r, i, m;
+  guint n_jobs, j;
+
+  model.fitts_a = 0.05;
+  model.fitts_b = 0.15;
+  model.overshoot = 0.05;
+  model.ballistic = 0.3;
+  model.rate = 125;
+  model.frame_interval = 30;
+  model.trials = 2000;
+  model.seed = 1;
+
+  context = g_option_context_new ("- simulate selections from a Fittsmenu");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  slices = parse_ints (slices_opt, &n_slices);
+  radii = parse_ints (radius_opt, &n_radii);
+  inners = parse_ints (inner_opt, &n_inners);
+  animations = parse_animations (animation_opt, &n_animations);
+  if (!slices || !radii || !inners || !animations || model.trials < 1 || model.rate < 1)
+    return 1;
+
+  // Every combination, skipping rings with no width
+  jobs = g_new0 (SimJob, n_slices * n_radii * n_inners * n_animations);
+  n_jobs = 0;
+  for (s = 0; s < n_slices; s++)
+    for (r = 0; r < n_radii; r++)
+      for (i = 0; i < n_inners; i++)
+        for (m = 0; m < n_animations; m++) {
+          if (slices[s] < 1 || inners[i] >= radii[r])
+            continue;
+          jobs[n_jobs].index = n_jobs;
+          jobs[n_jobs].n_slices = slices[s];
+          jobs[n_jobs].radius = radii[r];
+          jobs[n_jobs].inner_radius = inners[i];
+          jobs[n_jobs].animation = animations[m];
+          n_jobs++;
+        }
+
+  if (threads < 1)
+    threads = g_get_num_processors ();
+  pool = g_thread_pool_new (sim_run, NULL, threads, TRUE, NULL);
+  for (j = 0; j < n_jobs; j++)
+    g_thread_pool_push (pool, &jobs[j], NULL);
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  // In sweep order whatever order they finished in
+  g_print ("slices,radius,inner_radius,animation,trials,mean_ms,sd_ms,error_rate,movements\n");
+  for (j = 0; j < n_jobs; j++)
+    g_print ("%d,%d,%d,%s,%d,%.1f,%.1f,%.4f,%.2f\n",
+             jobs[j].n_slices, jobs[j].radius, jobs[j].inner_radius,
+             animation_names[jobs[j].animation], model.trials,
+             jobs[j].mean_ms, jobs[j].sd_ms, jobs[j].error_rate, jobs[j].movements);
+
+  g_free (jobs);
+  g_free (slices);
+  g_free (radii);
+  g_free (inners);
+  g_free (animations);
+  return 0;
+}
+
+/* Run every trial of one configuration on a core of its own. Trials are
+ * seeded from the configuration, so results don't depend on threading. */
+static void
+sim_run (gpointer data, gpointer user_data)
+{
+  SimJob *job = data;
+  FittsmenuCore *core;
+  FittsmenuCoreState state;
+  fittsmenu_slice **slices, *target, *active;
+  GRand *rand;
+  gdouble x, y, aim_x, aim_y, to_x, to_y, dx, dy, amplitude, along, across;
+  gdouble width, spread, duration, ms, sum, sum_sq;
+  gint64 time;
+  gint t, k, goal, errors, movements;
+  gchar *label;
+
+  core = fittsmenu_core_new ();
+  fittsmenu_core_set_menu_radius (core, job->radius);
+  fittsmenu_core_set_menu_inner_radius (core, job->inner_radius);
+  fittsmenu_core_set_animation (core, job->animation);
+  fittsmenu_core_set_frame_interval (core, model.frame_interval * 1000);
+  // Markers only, icons are never loaded
+  fittsmenu_core_set_lod_sizes (core, G_MAXINT, G_MAXINT, G_MAXINT);
+
+  slices = g_new (fittsmenu_slice*, job->n_slices);
+  for (k = 0; k < job->n_slices; k++) {
+    label = g_strdup_printf ("Slice %d", k);
+    slices[k] = fittsmenu_slice_new (label, NULL);
+    fittsmenu_core_append (core, fittsmenu_slice_ref (slices[k]));
+    g_free (label);
+  }
+
+  rand = g_rand_new_with_seed (model.seed + job->index * 7919);
+
+  sum = sum_sq = 0;
+  errors = movements = 0;
+  for (t = 0; t < model.trials; t++) {
+    // Each selection starts on a fresh popup under the pointer
+    fittsmenu_core_reset (core);
+    fittsmenu_core_get_state (core, &state);
+    state.menu_angle = 0;
+    state.menu_over = FALSE;
+    fittsmenu_core_set_state (core, &state);
+    fittsmenu_core_pointer_enter (core);
+
+    goal = g_rand_int_range (rand, 0, job->n_slices);
+    target = slices[goal];
+    width = sim_width (core, goal);
+    // Fitts' law errors are about 4% when endpoints spread this much
+    spread = width / 4.133;
+    x = y = job->radius;
+    time = 0;
+
+    for (k = 0; k < SIM_MAX_MOVEMENTS; k++) {
+      // The target as drawn now, a rotating ring may have moved it
+      sim_aim (core, goal, &aim_x, &aim_y);
+      dx = aim_x - x;
+      dy = aim_y - y;
+      amplitude = sqrt (dx * dx + dy * dy);
+      movements++;
+
+      if (amplitude >= SIM_MIN_AMPLITUDE) {
+        along = amplitude * (1 + model.overshoot) + gauss (rand) * spread;
+        across = gauss (rand) * spread;
+        to_x = x + (dx * along - dy * across) / amplitude;
+        to_y = y + (dy * along + dx * across) / amplitude;
+        duration = model.fitts_a + model.fitts_b * log2 (amplitude / width + 1);
+        time = sim_move (core, &x, &y, to_x, to_y, duration, time);
+      }
+
+      // Experts often click as the first movement ends
+      if (k == 0 && g_rand_double (rand) < model.ballistic)
+        break;
+
+      time = sim_pause (core, x, y, SIM_VERIFY_TIME, time);
+      if (fittsmenu_core_pick (core) == target)
+        break;
+    }
+
+    active = fittsmenu_core_activate (core);
+    if (active != target)
+      errors++;
+
+    ms = time / 1000.0;
+    sum += ms;
+    sum_sq += ms * ms;
+  }
+
+  job->mean_ms = sum / model.trials;
+  job->sd_ms = sqrt (MAX (sum_sq / model.trials - job->mean_ms * job->mean_ms, 0));
+  job->error_rate = (gdouble) errors / model.trials;
+  job->movements = (gdouble) movements / model.trials;
+
+  g_rand_free (rand);
+  for (k = 0; k < job->n_slices; k++)
+    fittsmenu_slice_unref (slices[k]);
+  g_free (slices);
+  fittsmenu_core_free (core);
+}
+
+/* Move the pointer from x, y to to_x, to_y along a minimum jerk path taking
+ * duration seconds, handing the core every sample. Returns the time at the
+ * end, in microseconds. */
+static gint64
+sim_move (FittsmenuCore *core, gdouble *x, gdouble *y, gdouble to_x, gdouble to_y,
+          gdouble duration, gint64 time)
+{
+  gint64 step;
+  gdouble tau, s;
+  gint i, n;
+
+  step = G_USEC_PER_SEC / model.rate;
+  n = MAX ((gint) ceil (duration * G_USEC_PER_SEC / step), 1);
+  for (i = 1; i <= n; i++) {
+    tau = (gdouble) i / n;
+    s = tau * tau * tau * (10 - 15 * tau + 6 * tau * tau);
+    fittsmenu_core_pointer_motion (core, *x + (to_x - *x) * s, *y + (to_y - *y) * s);
+    fittsmenu_core_advance (core, time + i * step);
+  }
+
+  *x = to_x;
+  *y = to_y;
+  return time + n * step;
+}
+
+/* Hold the pointer still, the core catches up with it meanwhile */
+static gint64
+sim_pause (FittsmenuCore *core, gdouble x, gdouble y, gdouble duration, gint64 time)
+{
+  gint64 step, end;
+
+  step = G_USEC_PER_SEC / model.rate;
+  end = time + duration * G_USEC_PER_SEC;
+  while (time < end) {
+    time += step;
+    fittsmenu_core_pointer_motion (core, x, y);
+    fittsmenu_core_advance (core, time);
+  }
+  return time;
+}
+
+/* The middle of slice index as the ring is drawn now, in menu co-ordinates.
+ * Pointer angles run clockwise from up. */
+static void
+sim_aim (FittsmenuCore *core, gint index, gdouble *x, gdouble *y)
+{
+  gdouble angle, distance;
+  gint radius;
+
+  radius = fittsmenu_core_get_menu_radius (core);
+  if (!fittsmenu_core_get_slice_centre (core, index, &angle, &distance, NULL, NULL)) {
+    *x = *y = radius;
+    return;
+  }
+
+  angle = angle * (G_PI / 180.0);
+  *x = radius + distance * sin (angle);
+  *y = radius - distance * cos (angle);
+}
+
+/* Width of a slice for Fitts' law, the smaller of its depth and its arc
+ * halfway across */
+static gdouble
+sim_width (FittsmenuCore *core, gint index)
+{
+  gdouble distance, depth, span;
+
+  if (!fittsmenu_core_get_slice_centre (core, index, NULL, &distance, &depth, &span))
+    return 1;
+  return MAX (MIN (depth, distance * span * (G_PI / 180.0)), 1);
+}
+
+/* Standard normal deviate, Box-Muller */
+static gdouble
+gauss (GRand *rand)
+{
+  gdouble u, v;
+
+  do
+    u = g_rand_double (rand);
+  while (u <= 0);
+  v = g_rand_double (rand);
+  return sqrt (-2 * log (u)) * cos (2 * G_PI * v);
+}
+
+/* A comma separated list of integers, NULL after reporting a bad one */
+static gint*
+parse_ints (const gchar *list, gint *n)
+{
+  gchar **items, *end;
+  gint *values;
+  gint i;
+
+  items = g_strsplit (list, ",", -1);
+  *n = g_strv_length (items);
+  values = g_new (gint, MAX (*n, 1));
+  for (i = 0; i < *n; i++) {
+    values[i] = strtol (items[i], &end, 10);
+    if (end == items[i] || *end) {
+      g_printerr ("Not a number: %s\n", items[i]);
+      g_strfreev (items);
+      g_free (values);
+      return NULL;
+    }
+  }
+  g_strfreev (items);
+  return values;
+}
+
+static gint*
+parse_animations (const gchar *list, gint *n)
+{
+  gchar **items;
+  gint *values;
+  guint m;
+  gint i;
+
+  items = g_strsplit (list, ",", -1);
+  *n = g_strv_length (items);
+  values = g_new (gint, MAX (*n, 1));
+  for (i = 0; i < *n; i++) {
+    for (m = 0; m < G_N_ELEMENTS (animation_names); m++)
+      if (!g_ascii_strcasecmp (items[i], animation_names[m]))
+        break;
+    if (m == G_N_ELEMENTS (animation_names)) {
+      g_printerr ("Unknown animation: %s\n", items[i]);
+      g_strfreev (items);
+      g_free (values);
+      return NULL;
+    }
+    values[i] = m;
+  }
+  g_strfreev (items);
+  return values;
+}
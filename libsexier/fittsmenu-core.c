@@ -0,0 +1,3663 @@
+/*******************************************************************************
+ * Fittsmenu core
+ *
+ *   Everything about a Fittsmenu that doesn't need a toolkit: the slices, the
+ *   ring layout, hit testing, the rotation state machine and the cairo
+ *   renderer. The widget front ends feed it pointer input and time, and give
+ *   it a cairo context to draw into.
+ *
+ ******************************************************************************/
+#if HAVE_CONFIG
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <cairo.h>
+#include <glib.h>
+#include <librsvg/rsvg.h>
+#include <librsvg/rsvg-cairo.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+
+#include "fittsmenu-core.h"
+
+/* How long the pointer rests on the first or last slice of a data source
+ * window before it scrolls by one, and again after each step */
+#define FITTSMENU_DWELL_SCROLL 500000
+
+/* Activations count for half as much after this many hours */
+#define FITTSMENU_USAGE_HALF_LIFE (24 * 14)
+
+/* Seconds after the last activation before the usage file is written */
+#define FITTSMENU_USAGE_SAVE_DELAY 5
+
+/* Slack around a slice's bounding circle for strokes and badges */
+#define FITTSMENU_BOUND_MARGIN 12
+
+typedef struct _FittsmenuSliceGeometry  FittsmenuSliceGeometry;
+typedef struct _FittsmenuRingGeometry   FittsmenuRingGeometry;
+
+struct _FittsmenuSnapshot
+{
+  gint              ref_count;
+  guint             n_slices;
+  fittsmenu_slice** slices;
+};
+
+struct _FittsmenuModel
+{
+  gint               ref_count;
+  FittsmenuSnapshot* snapshot;
+  GSList*            views;     // Bound cores, not referenced
+  gsize              raster_bytes; // Under raster_lru
+};
+
+/* Layout of a ring, the slices from first on lying between two radii */
+struct _FittsmenuRingGeometry
+{
+  guint          first;
+  guint          n_slices;
+  gdouble        inner_radius;
+  gdouble        outer_radius;
+  /* Where the slice outlines run, only the innermost ring reaches into the
+   * centre */
+  gdouble        inner_edge;
+  gdouble        outer_edge;
+};
+
+/* Layout of a single slice, relative to the menu centre at angle 0 */
+struct _FittsmenuSliceGeometry
+{
+  cairo_path_t*  path;
+  gdouble        angle_start;
+  gdouble        angle_end;
+  guint          ring;
+
+  /* Icon natural size and placement */
+  gboolean       icon_svg;
+  gint           icon_width;
+  gint           icon_height;
+  gdouble        icon_scale;
+  gdouble        icon_radius;   // Outer edge icons are placed against
+  gdouble        icon_x;
+  gdouble        icon_y;
+  gint           icon_offset_x;
+  gint           icon_offset_y;
+
+  /* Level of detail, below FITTSMENU_LOD_ICON a marker of marker_size is
+   * drawn centred on icon_x, icon_y. The icon is only loaded when the slice
+   * is shown in detail. */
+  gint           lod;
+  gdouble        marker_size;
+  gdouble        icon_angle;
+  gboolean       icon_pending;
+  gint           icon_serial;   // Of the icon loaded, see fittsmenu_slice_set_icon()
+
+  /* Circle around everything drawn for the slice, for damage and clipping */
+  gdouble        bound_x;
+  gdouble        bound_y;
+  gdouble        bound_radius;
+};
+
+struct _FittsmenuCore
+{
+  /* Adopted contents, slices lists them for the renderer */
+  FittsmenuSnapshot*  snapshot;
+  GList*         slices;
+
+  /* Newest published snapshot, swapped in by fittsmenu_core_sync() */
+  gpointer       pending;
+  FittsmenuCoreNotify publish_notify;
+  gpointer       publish_data;
+
+  /* Slices changed in place, referenced, waiting for
+   * fittsmenu_core_take_damage(). damage_icons is set when an icon was
+   * replaced and the sprites are stale. */
+  GSList*        damage;
+  gboolean       damage_icons;
+  FittsmenuCoreNotify damage_notify;
+  gpointer       damage_data;
+
+  /* Shown in the centre disc, under the preview lock */
+  cairo_surface_t* preview;
+
+  /* Shared contents this core is a view of */
+  FittsmenuModel* model;
+
+  fittsmenu_slice*      active;
+  fittsmenu_slice*      hover;
+
+  /* Widget Geometry */
+  gdouble        menu_radius;
+  gdouble        menu_inner_radius;
+
+  /* Concentric rings, innermost first, none for a single ring */
+  FittsmenuRing* rings;
+  guint          n_rings;
+
+  gint			 animation;
+  gboolean       overlay;
+  gboolean       remote;
+  gchar*         missing_icon;
+
+  /* Widget State */
+  gboolean       menu_over;
+  gint           menu_angle;
+  gint           menu_angle_offset;
+  gint           menu_angle_diff;
+
+  /* Ring angle strokes are marked against, set by the usage orientation */
+  gint           mark_angle;
+
+  /* Last known mouse state */
+  gdouble        mouse_angle;
+  gdouble        mouse_distance;
+
+  /* Pointer position waiting for the next advance */
+  gboolean       pointer_pending;
+  gdouble        pointer_x;
+  gdouble        pointer_y;
+  gint64         frame_interval;
+  gint64         last_update;
+
+  /* Data source, the snapshot is the window starting at source_first */
+  FittsmenuSliceFunc  source_func;
+  gpointer       source_data;
+  GDestroyNotify source_notify;
+  guint          source_items;
+  guint          source_visible;
+  guint          source_first;
+  GHashTable*    source_cache;
+
+  /* Adaptive placement, the usage file and the slice the ring opens
+   * towards for the rest of the session */
+  gchar*         usage_id;
+  GKeyFile*      usage;
+  gboolean       usage_dirty;
+  guint          usage_save_id;
+  gdouble        approach_angle;
+  gboolean       session_picked;
+  gchar*         session_key;
+
+  /* Edge the pointer is resting on, -1 or 1, and since when */
+  gint           dwell_edge;
+  gint64         dwell_start;
+
+  /* Bytes held by this menu's icon rasters */
+  gsize          raster_bytes;
+
+  /* Scratch arena for per frame temporaries, cleared on every render */
+  GStringChunk*  scratch;
+
+  /* Slice styles by state, with their fills compiled to patterns */
+  FittsmenuSliceStyle styles[FITTSMENU_STATE_LAST];
+  cairo_pattern_t* style_fills[FITTSMENU_STATE_LAST];
+
+  /* Colours alpha only icons are drawn in, unset ones fall back to normal
+   * and then to the colour of the icon itself */
+  gdouble        tints[FITTSMENU_STATE_LAST][4];
+  gboolean       tint_set[FITTSMENU_STATE_LAST];
+
+  /* Smallest icon sizes, in pixels, drawn as an icon, glyph or swatch */
+  gint           lod_icon_min;
+  gint           lod_glyph_min;
+  gint           lod_swatch_min;
+
+  /* Sprite cache, the ring without hover at sprite_angles evenly spaced
+   * angles, kept within sprite_max bytes */
+  cairo_surface_t** sprites;
+  guint          sprite_angles;
+  gsize          sprite_max;
+  gsize          sprite_bytes;
+
+  /* Layout cache, rebuilt when slices or radii change */
+  FittsmenuSliceGeometry* geometry;
+  guint          geometry_slices;
+  gboolean       geometry_valid;
+
+  /* Rings as laid out, empty ones left out, and the ring at each whole
+   * pixel of distance from the centre for hit testing */
+  FittsmenuRingGeometry* ring_geometry;
+  guint          ring_count;
+  guint8*        ring_at;
+  guint          ring_at_size;
+};
+
+static gboolean geometry_update (FittsmenuCore *core);
+static void geometry_invalidate (FittsmenuCore *core);
+static void core_adopt (FittsmenuCore *core, FittsmenuSnapshot *snapshot);
+static gboolean core_apply_pointer (FittsmenuCore *core, gint64 time);
+static gboolean core_dwell (FittsmenuCore *core, gint64 time);
+static gint core_hover_index (FittsmenuCore *core);
+static gint core_index_at (FittsmenuCore *core, gdouble mouse_angle, gdouble distance,
+                           gint angle);
+static void source_update (FittsmenuCore *core);
+static void core_orient (FittsmenuCore *core);
+static gchar* slice_dup_usage_key (fittsmenu_slice *slice);
+static gchar* usage_path (void);
+static GKeyFile* usage_load (void);
+static void usage_record (FittsmenuCore *core, fittsmenu_slice *slice);
+static gboolean usage_save_timeout (gpointer data);
+static void usage_save (FittsmenuCore *core);
+static fittsmenu_slice* source_get (FittsmenuCore *core, guint index);
+static gboolean source_out_of_window (gpointer key, gpointer value, gpointer data);
+static fittsmenu_slice* core_draw_ring (FittsmenuCore *core, cairo_t *cr, gint angle, gint hover_index);
+static fittsmenu_slice* core_blit_ring (FittsmenuCore *core, cairo_t *cr, cairo_surface_t *sprite, gint angle, gint hover_index);
+static void core_draw_status (FittsmenuCore *core, cairo_t *cr, gint angle);
+static void core_draw_preview (FittsmenuCore *core, cairo_t *cr);
+static void core_slice_bound (FittsmenuCore *core, gint i, gint angle, gdouble *x, gdouble *y, gdouble *radius);
+static gboolean core_slice_in_clip (FittsmenuCore *core, gint i, gint angle, const gdouble *clip);
+static gboolean core_apply_damage (FittsmenuCore *core);
+static void slice_damage (fittsmenu_slice *slice, gboolean icon);
+static void slice_cores_update (FittsmenuCore *core, FittsmenuSnapshot *old, FittsmenuSnapshot *snapshot);
+static guint core_detail_slices (FittsmenuCore *core, gint hover_index, gint *detail);
+static void core_draw_details (FittsmenuCore *core, cairo_t *cr, const cairo_matrix_t *base, gint angle, gint hover_index, const gint *detail, guint n_detail);
+static void core_draw_slice (FittsmenuCore *core, cairo_t *cr, const cairo_matrix_t *base, gint angle, gint i, fittsmenu_slice *slice, gboolean hovered, gboolean detail);
+static void core_draw_icon (FittsmenuCore *core, cairo_t *cr, const cairo_matrix_t *base, gint angle, gint i, fittsmenu_slice *slice, gboolean hovered);
+static void core_draw_marker (FittsmenuCore *core, cairo_t *cr, gint angle, fittsmenu_slice *slice, FittsmenuSliceGeometry *geom, gboolean hovered);
+static void core_marker_colour (FittsmenuCore *core, gint tint, gdouble *rgba);
+static gint core_slice_state (FittsmenuCore *core, fittsmenu_slice *slice, gboolean hovered);
+static cairo_pattern_t* core_style_fill (FittsmenuCore *core, gint state);
+static void core_styles_changed (FittsmenuCore *core);
+static void slice_swatch_colour (fittsmenu_slice *slice, gdouble *rgb);
+static gint core_lod (FittsmenuCore *core, gdouble size);
+static void geometry_place_icon (FittsmenuCore *core, fittsmenu_slice *slice, FittsmenuSliceGeometry *geom, gdouble size);
+static guint geometry_layout_rings (FittsmenuCore *core, guint no_of_slices);
+static void geometry_bound (FittsmenuSliceGeometry *geom, gdouble inner_edge, gdouble outer_edge);
+static gint core_draw_angle (FittsmenuCore *core);
+static guint sprite_index (FittsmenuCore *core, gint angle);
+static gint sprite_angle (FittsmenuCore *core, guint index);
+static cairo_surface_t* sprite_get (FittsmenuCore *core, gint angle, cairo_surface_t *target);
+static void sprites_clear (FittsmenuCore *core);
+static void slice_destroy (fittsmenu_slice *slice);
+static gboolean slice_load_icon (FittsmenuCore *core, fittsmenu_slice *slice, FittsmenuSliceGeometry *geom);
+static gboolean geometry_update_rings (FittsmenuCore *core);
+static FittsmenuRingGeometry* geometry_ring_of (FittsmenuCore *core, guint index);
+static gboolean slice_load_icon_unlocked (FittsmenuCore *core, fittsmenu_slice *slice, FittsmenuSliceGeometry *geom);
+static gboolean slice_load_data (fittsmenu_slice *slice, FittsmenuSliceGeometry *geom);
+static GdkPixbuf* slice_decode (fittsmenu_slice *slice, gint width, gint height, GError **error);
+static gboolean data_is_svg (GBytes *bytes);
+static gboolean data_get_info (GBytes *bytes, gint *width, gint *height);
+static void slice_rasterize (FittsmenuCore *core, cairo_t *cr, fittsmenu_slice *slice, FittsmenuSliceGeometry *geom);
+static void slice_rasterize_unlocked (FittsmenuCore *core, cairo_t *cr, fittsmenu_slice *slice, FittsmenuSliceGeometry *geom);
+static void raster_size (FittsmenuSliceGeometry *geom, gint *width, gint *height);
+static cairo_surface_t* raster_upload (cairo_t *cr, cairo_surface_t *surface, gint width, gint height);
+static void raster_keep (FittsmenuCore *core, cairo_t *cr, fittsmenu_slice *slice, cairo_surface_t *surface, gint width, gint height, gsize bytes);
+static cairo_surface_t* pixbuf_to_surface (GdkPixbuf *pixbuf);
+static cairo_surface_t* raster_to_mask (fittsmenu_slice *slice, cairo_surface_t *surface);
+static void core_icon_tint (FittsmenuCore *core, fittsmenu_slice *slice, gint tint, gdouble *rgba);
+static void core_set_active (FittsmenuCore *core, fittsmenu_slice *slice);
+static void raster_account (FittsmenuCore *core, fittsmenu_slice *slice, cairo_surface_t *surface, gint width, gint height, gsize bytes);
+static cairo_surface_t* raster_get (fittsmenu_slice *slice, gint *width, gint *height);
+static void raster_release (fittsmenu_slice *slice);
+static void raster_release_unlocked (fittsmenu_slice *slice);
+static void raster_release_left (FittsmenuSnapshot *old, FittsmenuSnapshot *snapshot, FittsmenuCore *core, FittsmenuModel *model);
+static void raster_enforce_budget (fittsmenu_slice *keep);
+static void recpol(gdouble x, gdouble y, gdouble *pr, gdouble *pa);
+static void polrec(gdouble r, gdouble a, gdouble *px, gdouble *py);
+
+/* Guards the contents of models and the views bound to them */
+G_LOCK_DEFINE_STATIC (models);
+
+/* Held while a model's contents are handed to its views, so they see its
+ * snapshots in order and none is unbound halfway. The publish notifies run
+ * under it rather than under models. Taken before models. */
+G_LOCK_DEFINE_STATIC (model_publish);
+
+/* Guards the publish notify of every core, so unsetting it waits for a
+ * notify already running. Taken after model_publish. */
+G_LOCK_DEFINE_STATIC (publish);
+
+/* Guards the live state of slices and their icons, which
+ * fittsmenu_slice_set_icon() may swap while another thread draws them.
+ * Taken before raster_lru. */
+G_LOCK_DEFINE_STATIC (slice_state);
+
+/* Guards the preview of every core, set from the main loop while a render
+ * thread may be drawing it */
+G_LOCK_DEFINE_STATIC (preview);
+
+/* The menus showing each slice, for handing out damage, and the damage of
+ * each menu */
+G_LOCK_DEFINE_STATIC (damage);
+
+/* Icon rasters of every menu, most recently painted at the head. Slices can
+ * be dropped by whichever thread holds their last reference. */
+G_LOCK_DEFINE_STATIC (raster_lru);
+static GQueue *raster_lru = NULL;
+static gsize   raster_bytes = 0;
+static gsize   raster_budget = 0;
+
+/* Flat translucent black, hover lifts the slice to a lighter grey */
+static const FittsmenuSliceStyle default_styles[FITTSMENU_STATE_LAST] =
+{
+  { { 0, 0, 0, .7 },    { 0, 0, 0, .7 },    { 0, 0, 0, .1 }, 3 },
+  { { .3, .3, .3, .5 }, { .3, .3, .3, .5 }, { 0, 0, 0, .1 }, 3 },
+  { { 0, 0, 0, .7 },    { 0, 0, 0, .7 },    { 0, 0, 0, .1 }, 3 },
+  { { 0, 0, 0, .45 },   { 0, 0, 0, .45 },   { 0, 0, 0, .1 }, 3 }
+};
+
+/* Menu angles are whole degrees, so their rotations are tabulated */
+static gdouble  angle_cos[360];
+static gdouble  angle_sin[360];
+static gsize    angle_table_ready = 0;
+
+FittsmenuCore*
+fittsmenu_core_new (void)
+{
+  FittsmenuCore *core;
+  gint i;
+
+  // Cores may be made on several threads at once, such as by a simulator
+  if (g_once_init_enter(&angle_table_ready)) {
+    for (i = 0; i < 360; i++) {
+      angle_cos[i] = cos(i * (G_PI / 180.0f));
+      angle_sin[i] = sin(i * (G_PI / 180.0f));
+    }
+    g_once_init_leave(&angle_table_ready, 1);
+  }
+
+  rsvg_init();
+
+  core = g_slice_new0(FittsmenuCore);
+  core->menu_radius = 120;
+  core->menu_inner_radius = 80;
+  core->animation = FITTSMENU_ANIM_CROTATE;
+  core->frame_interval = 30000;
+  core->last_update = G_MININT64;
+  core->scratch = g_string_chunk_new(256);
+  core->lod_icon_min = 16;
+  core->lod_glyph_min = 10;
+  core->lod_swatch_min = 6;
+  memcpy(core->styles, default_styles, sizeof (default_styles));
+  return core;
+}
+
+void
+fittsmenu_core_free (FittsmenuCore *core)
+{
+  FittsmenuSnapshot *pending;
+  fittsmenu_slice *slice;
+  GList *list;
+
+  fittsmenu_core_set_model(core, NULL);
+
+  G_LOCK (damage);
+  if (core->snapshot)
+    slice_cores_update(core, core->snapshot, NULL);
+  g_slist_free_full(core->damage, (GDestroyNotify)fittsmenu_slice_unref);
+  G_UNLOCK (damage);
+
+  // Slices may outlive us in someone else's snapshot, take our rasters back
+  for (list = core->slices;list;list = list->next) {
+    slice = (fittsmenu_slice *)list->data;
+    if (slice->core == core)
+      raster_release(slice);
+  }
+  g_list_free(core->slices);
+  if (core->snapshot)
+    fittsmenu_snapshot_unref(core->snapshot);
+
+  pending = g_atomic_pointer_get(&core->pending);
+  if (pending)
+    fittsmenu_snapshot_unref(pending);
+
+  if (core->source_cache)
+    g_hash_table_destroy(core->source_cache);
+  if (core->source_notify)
+    core->source_notify(core->source_data);
+
+  usage_save(core);
+  if (core->usage)
+    g_key_file_free(core->usage);
+  g_free(core->usage_id);
+  g_free(core->session_key);
+
+  geometry_invalidate(core);
+  core_styles_changed(core);
+  if (core->preview)
+    cairo_surface_destroy(core->preview);
+  g_free(core->sprites);
+  g_free(core->rings);
+  g_string_chunk_free(core->scratch);
+  g_free(core->missing_icon);
+  g_slice_free(FittsmenuCore, core);
+}
+
+/* Getters/Setters */
+void
+fittsmenu_core_set_animation (FittsmenuCore *core, gint value)
+{
+  core->animation = value;
+}
+
+gint
+fittsmenu_core_get_animation (FittsmenuCore *core)
+{
+  return core->animation;
+}
+
+void
+fittsmenu_core_set_menu_radius (FittsmenuCore *core, gint value)
+{
+  core->menu_radius = value;
+  geometry_invalidate(core);
+  core_styles_changed(core);
+}
+
+gint
+fittsmenu_core_get_menu_radius (FittsmenuCore *core)
+{
+  return core->menu_radius;
+}
+
+void
+fittsmenu_core_set_menu_inner_radius (FittsmenuCore *core, gint value)
+{
+  core->menu_inner_radius = value;
+  geometry_invalidate(core);
+  core_styles_changed(core);
+}
+
+gint
+fittsmenu_core_get_menu_inner_radius (FittsmenuCore *core)
+{
+  return core->menu_inner_radius;
+}
+
+/* Composite the menu over whatever is already drawn instead of replacing it,
+ * for drawing into a host's surface rather than our own cleared window */
+void
+fittsmenu_core_set_overlay (FittsmenuCore *core, gboolean value)
+{
+  core->overlay = value;
+  sprites_clear(core);
+}
+
+/* Minimum time between applied pointer updates, 0 leaves pacing to the
+ * caller, for example a frame clock */
+void
+fittsmenu_core_set_frame_interval (FittsmenuCore *core, gint64 usec)
+{
+  core->frame_interval = usec;
+}
+
+/* SVG used for icons that fail to load */
+void
+fittsmenu_core_set_missing_icon (FittsmenuCore *core, const gchar *path)
+{
+  g_free(core->missing_icon);
+  core->missing_icon = g_strdup(path);
+}
+
+/* Remember activations under menu_id, NULL turns adaptive placement off */
+void
+fittsmenu_core_set_usage_id (FittsmenuCore *core, const gchar *menu_id)
+{
+  usage_save(core);
+  if (core->usage)
+    g_key_file_free(core->usage);
+  core->usage = NULL;
+  g_free(core->usage_id);
+  core->usage_id = g_strdup(menu_id);
+
+  // A new id starts a new session
+  core->session_picked = FALSE;
+  g_free(core->session_key);
+  core->session_key = NULL;
+
+  if (menu_id)
+    core->usage = usage_load();
+}
+
+const gchar*
+fittsmenu_core_get_usage_id (FittsmenuCore *core)
+{
+  return core->usage_id;
+}
+
+void
+fittsmenu_core_set_approach_angle (FittsmenuCore *core, gdouble degrees)
+{
+  core->approach_angle = degrees;
+}
+
+/* Actions, these replace the snapshot straight away and belong to the
+ * thread the menu is drawn from */
+void
+fittsmenu_core_append (FittsmenuCore *core, fittsmenu_slice *slice)
+{
+  FittsmenuSnapshot *snapshot;
+  fittsmenu_slice **slices;
+  guint i, n_slices;
+  GList *list;
+
+  // Views change the model and see it at once, like any other menu
+  if (core->model) {
+    fittsmenu_model_append(core->model, slice);
+    fittsmenu_core_sync(core);
+    return;
+  }
+
+  // Build on the newest contents, including anything just published
+  fittsmenu_core_sync(core);
+
+  n_slices = g_list_length(core->slices);
+  slices = g_new(fittsmenu_slice*, n_slices + 1);
+  for (i = 0, list = core->slices; list; i++, list = list->next)
+    slices[i] = (fittsmenu_slice *)list->data;
+  slices[n_slices] = slice;
+
+  snapshot = fittsmenu_snapshot_new(slices, n_slices + 1);
+  g_free(slices);
+  fittsmenu_slice_unref(slice);
+  core_adopt(core, snapshot);
+}
+
+void
+fittsmenu_core_remove (FittsmenuCore *core, fittsmenu_slice *slice)
+{
+  FittsmenuSnapshot *snapshot;
+  fittsmenu_slice **slices;
+  guint n_slices;
+  GList *list;
+
+  if (core->model) {
+    fittsmenu_model_remove(core->model, slice);
+    fittsmenu_core_sync(core);
+    return;
+  }
+
+  fittsmenu_core_sync(core);
+
+  if (!g_list_find(core->slices, slice))
+    return;
+
+  slices = g_new(fittsmenu_slice*, g_list_length(core->slices));
+  for (n_slices = 0, list = core->slices; list; list = list->next)
+    if (list->data != slice)
+      slices[n_slices++] = (fittsmenu_slice *)list->data;
+
+  snapshot = fittsmenu_snapshot_new(slices, n_slices);
+  g_free(slices);
+  core_adopt(core, snapshot);
+}
+
+/* Snapshots */
+FittsmenuSnapshot*
+fittsmenu_snapshot_new (fittsmenu_slice **slices, guint n_slices)
+{
+  FittsmenuSnapshot *snapshot;
+  guint i;
+
+  snapshot = g_slice_new(FittsmenuSnapshot);
+  snapshot->ref_count = 1;
+  snapshot->n_slices = n_slices;
+  snapshot->slices = g_new(fittsmenu_slice*, n_slices);
+  for (i = 0; i < n_slices; i++)
+    snapshot->slices[i] = fittsmenu_slice_ref(slices[i]);
+  return snapshot;
+}
+
+FittsmenuSnapshot*
+fittsmenu_snapshot_ref (FittsmenuSnapshot *snapshot)
+{
+  g_atomic_int_inc(&snapshot->ref_count);
+  return snapshot;
+}
+
+void
+fittsmenu_snapshot_unref (FittsmenuSnapshot *snapshot)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test(&snapshot->ref_count))
+    return;
+
+  for (i = 0; i < snapshot->n_slices; i++)
+    fittsmenu_slice_unref(snapshot->slices[i]);
+  g_free(snapshot->slices);
+  g_slice_free(FittsmenuSnapshot, snapshot);
+}
+
+guint
+fittsmenu_snapshot_get_n_slices (FittsmenuSnapshot *snapshot)
+{
+  return snapshot->n_slices;
+}
+
+fittsmenu_slice*
+fittsmenu_snapshot_get_slice (FittsmenuSnapshot *snapshot, guint index)
+{
+  g_return_val_if_fail (index < snapshot->n_slices, NULL);
+  return snapshot->slices[index];
+}
+
+/* Hand a snapshot to the menu from any thread. A snapshot published before
+ * the previous one was adopted replaces it, the menu only wants the newest. */
+void
+fittsmenu_core_publish (FittsmenuCore *core, FittsmenuSnapshot *snapshot)
+{
+  gpointer old;
+
+  g_return_if_fail (snapshot != NULL);
+
+  fittsmenu_snapshot_ref(snapshot);
+  do {
+    old = g_atomic_pointer_get(&core->pending);
+  } while (!g_atomic_pointer_compare_and_exchange(&core->pending, old, snapshot));
+
+  if (old)
+    fittsmenu_snapshot_unref((FittsmenuSnapshot *)old);
+
+  G_LOCK (publish);
+  if (core->publish_notify)
+    core->publish_notify(core, core->publish_data);
+  G_UNLOCK (publish);
+}
+
+/* Called on the publishing thread after each fittsmenu_core_publish(). Once
+ * unset the notify is not running and won't be called again. */
+void
+fittsmenu_core_set_publish_notify (FittsmenuCore *core, FittsmenuCoreNotify func,
+                                   gpointer user_data)
+{
+  G_LOCK (publish);
+  core->publish_notify = func;
+  core->publish_data = user_data;
+  G_UNLOCK (publish);
+}
+
+/* Called on the changing thread whenever a slice the core shows is changed
+ * in place. Once unset the notify is not running and won't be called
+ * again. */
+void
+fittsmenu_core_set_damage_notify (FittsmenuCore *core, FittsmenuCoreNotify func,
+                                  gpointer user_data)
+{
+  G_LOCK (damage);
+  core->damage_notify = func;
+  core->damage_data = user_data;
+  G_UNLOCK (damage);
+}
+
+/* The area covering every slice of this menu changed in place since the
+ * last call, at the angle the next frame is drawn at. Slices the menu
+ * doesn't show are dropped. */
+gboolean
+fittsmenu_core_take_damage (FittsmenuCore *core, gint *x, gint *y,
+                            gint *width, gint *height)
+{
+  GSList *damage, *list;
+  gdouble cx, cy, radius, x1, y1, x2, y2;
+  gboolean found;
+  gint i, angle;
+
+  G_LOCK (damage);
+  damage = core->damage;
+  core->damage = NULL;
+  G_UNLOCK (damage);
+  core_apply_damage(core);
+
+  found = FALSE;
+  x1 = y1 = x2 = y2 = 0;
+  angle = core_draw_angle(core);
+  for (list = damage; list; list = list->next) {
+    i = g_list_index(core->slices, list->data);
+    if (i < 0)
+      continue;
+
+    // Laid out again on the next frame anyway, all of it is drawn
+    if (!core->geometry_valid) {
+      cx = cy = radius = core->menu_radius;
+    } else {
+      core_slice_bound(core, i, angle, &cx, &cy, &radius);
+    }
+    x1 = found ? MIN(x1, cx - radius) : cx - radius;
+    y1 = found ? MIN(y1, cy - radius) : cy - radius;
+    x2 = found ? MAX(x2, cx + radius) : cx + radius;
+    y2 = found ? MAX(y2, cy + radius) : cy + radius;
+    found = TRUE;
+  }
+  g_slist_free_full(damage, (GDestroyNotify)fittsmenu_slice_unref);
+
+  if (!found)
+    return FALSE;
+
+  *x = MAX(floor(x1), 0);
+  *y = MAX(floor(y1), 0);
+  *width = MIN(ceil(x2), core->menu_radius * 2) - *x;
+  *height = MIN(ceil(y2), core->menu_radius * 2) - *y;
+  return TRUE;
+}
+
+/* Drop the sprites if an icon was replaced since the last frame, returns
+ * TRUE if they were. Cores nobody takes damage from drop it here. */
+static gboolean
+core_apply_damage (FittsmenuCore *core)
+{
+  GSList *damage = NULL;
+  gboolean icons;
+
+  G_LOCK (damage);
+  icons = core->damage_icons;
+  core->damage_icons = FALSE;
+  if (!core->damage_notify) {
+    damage = core->damage;
+    core->damage = NULL;
+  }
+  G_UNLOCK (damage);
+
+  g_slist_free_full(damage, (GDestroyNotify)fittsmenu_slice_unref);
+  if (icons)
+    sprites_clear(core);
+  return icons;
+}
+
+/* Hand a changed slice to the menus showing it */
+static void
+slice_damage (fittsmenu_slice *slice, gboolean icon)
+{
+  FittsmenuCore *core;
+  GSList *list;
+
+  G_LOCK (damage);
+  for (list = slice->cores; list; list = list->next) {
+    core = list->data;
+    core->damage_icons = core->damage_icons || icon;
+    if (g_slist_find(core->damage, slice))
+      continue;
+    core->damage = g_slist_prepend(core->damage, fittsmenu_slice_ref(slice));
+    // One wakeup for everything changed before the damage is taken
+    if (core->damage_notify && !core->damage->next)
+      core->damage_notify(core, core->damage_data);
+  }
+  G_UNLOCK (damage);
+}
+
+/* Move core from the slices of old to those of snapshot, either may be
+ * NULL. A slice shown twice lists the core twice. Called under the damage
+ * lock. */
+static void
+slice_cores_update (FittsmenuCore *core, FittsmenuSnapshot *old,
+                    FittsmenuSnapshot *snapshot)
+{
+  fittsmenu_slice *slice;
+  guint i;
+
+  for (i = 0; snapshot && i < snapshot->n_slices; i++) {
+    slice = snapshot->slices[i];
+    slice->cores = g_slist_prepend(slice->cores, core);
+  }
+  for (i = 0; old && i < old->n_slices; i++) {
+    slice = old->slices[i];
+    slice->cores = g_slist_remove(slice->cores, core);
+  }
+}
+
+/* Models */
+FittsmenuModel*
+fittsmenu_model_new (void)
+{
+  FittsmenuModel *model;
+
+  model = g_slice_new0(FittsmenuModel);
+  model->ref_count = 1;
+  model->snapshot = fittsmenu_snapshot_new(NULL, 0);
+  return model;
+}
+
+FittsmenuModel*
+fittsmenu_model_ref (FittsmenuModel *model)
+{
+  g_atomic_int_inc(&model->ref_count);
+  return model;
+}
+
+void
+fittsmenu_model_unref (FittsmenuModel *model)
+{
+  if (!g_atomic_int_dec_and_test(&model->ref_count))
+    return;
+
+  // Views hold a reference, so there are none left. The rasters charged
+  // to the model go with it.
+  raster_release_left(model->snapshot, NULL, NULL, model);
+  fittsmenu_snapshot_unref(model->snapshot);
+  g_slice_free(FittsmenuModel, model);
+}
+
+/* Make snapshot the contents of the model and of every view of it */
+void
+fittsmenu_model_publish (FittsmenuModel *model, FittsmenuSnapshot *snapshot)
+{
+  FittsmenuSnapshot *old;
+  GSList *views, *list;
+
+  g_return_if_fail (snapshot != NULL);
+
+  G_LOCK (model_publish);
+  G_LOCK (models);
+  old = model->snapshot;
+  model->snapshot = fittsmenu_snapshot_ref(snapshot);
+  views = g_slist_copy(model->views);
+  G_UNLOCK (models);
+
+  // A notify may read the model
+  for (list = views; list; list = list->next)
+    fittsmenu_core_publish((FittsmenuCore *)list->data, snapshot);
+  G_UNLOCK (model_publish);
+  g_slist_free(views);
+
+  raster_release_left(old, snapshot, NULL, model);
+  fittsmenu_snapshot_unref(old);
+}
+
+/* The model's contents, as a new reference */
+FittsmenuSnapshot*
+fittsmenu_model_get_snapshot (FittsmenuModel *model)
+{
+  FittsmenuSnapshot *snapshot;
+
+  G_LOCK (models);
+  snapshot = fittsmenu_snapshot_ref(model->snapshot);
+  G_UNLOCK (models);
+  return snapshot;
+}
+
+/* Append takes over the caller's reference, like fittsmenu_core_append() */
+void
+fittsmenu_model_append (FittsmenuModel *model, fittsmenu_slice *slice)
+{
+  FittsmenuSnapshot *old, *snapshot;
+  fittsmenu_slice **slices;
+
+  old = fittsmenu_model_get_snapshot(model);
+  slices = g_new(fittsmenu_slice*, old->n_slices + 1);
+  memcpy(slices, old->slices, old->n_slices * sizeof (fittsmenu_slice*));
+  slices[old->n_slices] = slice;
+
+  snapshot = fittsmenu_snapshot_new(slices, old->n_slices + 1);
+  g_free(slices);
+  fittsmenu_slice_unref(slice);
+  fittsmenu_snapshot_unref(old);
+
+  fittsmenu_model_publish(model, snapshot);
+  fittsmenu_snapshot_unref(snapshot);
+}
+
+void
+fittsmenu_model_remove (FittsmenuModel *model, fittsmenu_slice *slice)
+{
+  FittsmenuSnapshot *old, *snapshot;
+  fittsmenu_slice **slices;
+  guint i, n_slices;
+
+  old = fittsmenu_model_get_snapshot(model);
+  slices = g_new(fittsmenu_slice*, old->n_slices);
+  for (i = 0, n_slices = 0; i < old->n_slices; i++)
+    if (old->slices[i] != slice)
+      slices[n_slices++] = old->slices[i];
+
+  if (n_slices < old->n_slices) {
+    snapshot = fittsmenu_snapshot_new(slices, n_slices);
+    fittsmenu_model_publish(model, snapshot);
+    fittsmenu_snapshot_unref(snapshot);
+  }
+  g_free(slices);
+  fittsmenu_snapshot_unref(old);
+}
+
+/* Make the core a view of model, it shows the model's slices and follows
+ * every change to them while keeping its own angle and hover. NULL leaves
+ * the model, keeping the slices last shown. */
+void
+fittsmenu_core_set_model (FittsmenuCore *core, FittsmenuModel *model)
+{
+  FittsmenuModel *old;
+  FittsmenuSnapshot *snapshot = NULL;
+
+  if (model == core->model)
+    return;
+
+  old = core->model;
+  if (model)
+    fittsmenu_model_ref(model);
+
+  // Waits for a publish to the old model that may still be handing it
+  // this core
+  G_LOCK (model_publish);
+  G_LOCK (models);
+  if (old)
+    old->views = g_slist_remove(old->views, core);
+  core->model = model;
+  if (model) {
+    model->views = g_slist_prepend(model->views, core);
+    snapshot = fittsmenu_snapshot_ref(model->snapshot);
+  }
+  G_UNLOCK (models);
+
+  if (snapshot) {
+    fittsmenu_core_publish(core, snapshot);
+    fittsmenu_snapshot_unref(snapshot);
+  }
+  G_UNLOCK (model_publish);
+
+  if (old)
+    fittsmenu_model_unref(old);
+}
+
+FittsmenuModel*
+fittsmenu_core_get_model (FittsmenuCore *core)
+{
+  return core->model;
+}
+
+/* Adopt the newest published snapshot, returns TRUE if there was one. Called
+ * at the start of every frame, so a frame always sees a single snapshot. */
+gboolean
+fittsmenu_core_sync (FittsmenuCore *core)
+{
+  gpointer snapshot;
+
+  do {
+    snapshot = g_atomic_pointer_get(&core->pending);
+    if (!snapshot)
+      return FALSE;
+  } while (!g_atomic_pointer_compare_and_exchange(&core->pending, snapshot, NULL));
+
+  core_adopt(core, (FittsmenuSnapshot *)snapshot);
+  return TRUE;
+}
+
+/* The snapshot being drawn, the menu keeps its reference */
+FittsmenuSnapshot*
+fittsmenu_core_get_snapshot (FittsmenuCore *core)
+{
+  return core->snapshot;
+}
+
+/* Make snapshot the menu contents, taking over its reference */
+static void
+core_adopt (FittsmenuCore *core, FittsmenuSnapshot *snapshot)
+{
+  FittsmenuSnapshot *old;
+  fittsmenu_slice *slice;
+  GList *list;
+  guint i;
+
+  old = core->snapshot;
+  G_LOCK (damage);
+  slice_cores_update(core, old, snapshot);
+  G_UNLOCK (damage);
+  g_list_free(core->slices);
+  core->slices = NULL;
+
+  for (i = snapshot->n_slices; i > 0; i--) {
+    slice = snapshot->slices[i - 1];
+    core->slices = g_list_prepend(core->slices, slice);
+  }
+
+  core->snapshot = snapshot;
+  if (core->active && !g_list_find(core->slices, core->active))
+    core->active = NULL;
+  if (core->hover && !g_list_find(core->slices, core->hover))
+    core->hover = NULL;
+  geometry_invalidate(core);
+
+  if (!old)
+    return;
+
+  // Slices leaving the menu take their rasters with them now, rather than
+  // whenever their last reference goes
+  raster_release_left(old, snapshot, core, NULL);
+  fittsmenu_snapshot_unref(old);
+}
+
+GList*
+fittsmenu_core_get_slices (FittsmenuCore *core)
+{
+  return core->slices;
+}
+
+fittsmenu_slice*
+fittsmenu_core_get_active (FittsmenuCore *core)
+{
+  return core->active;
+}
+
+fittsmenu_slice*
+fittsmenu_core_get_hover (FittsmenuCore *core)
+{
+  return core->hover;
+}
+
+/* Position of slice in this menu, or its item index for a data source.
+ * Other menus may show the same slice elsewhere. */
+gint
+fittsmenu_core_get_index (FittsmenuCore *core, fittsmenu_slice *slice)
+{
+  gint i;
+
+  i = g_list_index(core->slices, slice);
+  return i < 0 ? -1 : (gint)core->source_first + i;
+}
+
+void
+fittsmenu_core_set_active (FittsmenuCore *core,
+                           guint      index,
+                           fittsmenu_slice *slice)
+{
+  if (index)
+  	core_set_active(core, g_list_nth_data(core->slices, index));
+	if (slice)
+		core_set_active(core, slice);
+}
+
+/* Change the active slice, cached sprites show it in its tint */
+static void
+core_set_active (FittsmenuCore *core, fittsmenu_slice *slice)
+{
+  if (slice != core->active && core->tint_set[FITTSMENU_STATE_ACTIVE])
+    sprites_clear(core);
+  core->active = slice;
+}
+
+/* Colour to draw alpha only icons in, for a FITTSMENU_STATE_* state */
+void
+fittsmenu_core_set_icon_tint (FittsmenuCore *core, gint tint,
+                              gdouble red, gdouble green, gdouble blue, gdouble alpha)
+{
+  g_return_if_fail (tint >= 0 && tint < FITTSMENU_STATE_LAST);
+
+  core->tints[tint][0] = red;
+  core->tints[tint][1] = green;
+  core->tints[tint][2] = blue;
+  core->tints[tint][3] = alpha;
+  core->tint_set[tint] = TRUE;
+  sprites_clear(core);
+}
+
+/* Go back to drawing a state in the icon's own colour */
+void
+fittsmenu_core_unset_icon_tint (FittsmenuCore *core, gint tint)
+{
+  g_return_if_fail (tint >= 0 && tint < FITTSMENU_STATE_LAST);
+
+  core->tint_set[tint] = FALSE;
+  sprites_clear(core);
+}
+
+static void
+core_icon_tint (FittsmenuCore *core, fittsmenu_slice *slice, gint tint, gdouble *rgba)
+{
+  if (!core->tint_set[tint])
+    tint = FITTSMENU_STATE_NORMAL;
+
+  if (core->tint_set[tint]) {
+    memcpy(rgba, core->tints[tint], sizeof (core->tints[tint]));
+    return;
+  }
+
+  rgba[0] = slice->glyph_red;
+  rgba[1] = slice->glyph_green;
+  rgba[2] = slice->glyph_blue;
+  rgba[3] = 1.0;
+}
+
+/* Input */
+
+/* Forget the pointer, for a menu that has just been popped up */
+void
+fittsmenu_core_reset (FittsmenuCore *core)
+{
+  core->menu_over = FALSE;
+  core->pointer_pending = FALSE;
+  core->mark_angle = 0;
+
+  if (core->usage_id)
+    core_orient(core);
+}
+
+/* Turn the ring so the session's favourite slice is centred on the approach
+ * angle. The favourite is picked on the first popup and kept, so slices
+ * don't move under the user while they learn where things are. */
+static void
+core_orient (FittsmenuCore *core)
+{
+  fittsmenu_slice *slice;
+  FittsmenuRingGeometry *ring;
+  gchar *key;
+  GList *list;
+  gdouble score, best, weight, centre;
+  gboolean match;
+  gint *usage;
+  gsize length;
+  guint i;
+  gint now;
+
+  if (!core->session_picked) {
+    core->session_picked = TRUE;
+    now = time(NULL) / 3600;
+    best = 0;
+    for (list = core->slices; list; list = list->next) {
+      key = slice_dup_usage_key((fittsmenu_slice *)list->data);
+      usage = g_key_file_get_integer_list(core->usage, core->usage_id, key, &length, NULL);
+      if (usage && length == 2) {
+        // usage is the activation count and the hour of the last one
+        weight = pow(0.5, (gdouble)(now - usage[1]) / FITTSMENU_USAGE_HALF_LIFE);
+        score = usage[0] * weight;
+        if (score > best) {
+          best = score;
+          g_free(core->session_key);
+          core->session_key = key;
+          key = NULL;
+        }
+      }
+      g_free(usage);
+      g_free(key);
+    }
+  }
+
+  if (!core->session_key)
+    return;
+
+  if (!geometry_update_rings(core))
+    return;
+
+  for (i = 0, list = core->slices; list; i++, list = list->next) {
+    slice = (fittsmenu_slice *)list->data;
+    key = slice_dup_usage_key(slice);
+    match = !strcmp(key, core->session_key);
+    g_free(key);
+    if (!match)
+      continue;
+
+    // Slice centres are at cairo angles, 90 degrees behind mouse angles
+    ring = geometry_ring_of(core, i);
+    centre = (i - ring->first + 0.5) * (2*G_PI) / ring->n_slices;
+    core->menu_angle = (gint)floor(core->approach_angle - 90 - centre * (180.0 / G_PI)) % 360;
+    if (core->menu_angle < 0)
+      core->menu_angle = core->menu_angle + 360;
+    core->menu_angle_offset = core->menu_angle;
+    core->menu_angle_diff = 0;
+    core->mark_angle = core->menu_angle;
+    return;
+  }
+}
+
+void
+fittsmenu_core_pointer_motion (FittsmenuCore *core, gdouble x, gdouble y)
+{
+  core->pointer_x = x;
+  core->pointer_y = y;
+  core->pointer_pending = TRUE;
+}
+
+void
+fittsmenu_core_pointer_enter (FittsmenuCore *core)
+{
+	core->menu_angle_offset = core->menu_angle;
+  core->menu_over = FALSE;
+}
+
+void
+fittsmenu_core_pointer_leave (FittsmenuCore *core)
+{
+  core->menu_over = FALSE;
+}
+
+/* Apply the last pointer position, unless the previous update was less than
+ * a frame interval ago, and scroll a data source the pointer dwells on */
+gboolean
+fittsmenu_core_advance (FittsmenuCore *core, gint64 time)
+{
+  gboolean redraw = FALSE;
+
+  // If we've redrawn less than a frame interval ago don't redraw
+  if (core->pointer_pending && time >= core->last_update + core->frame_interval)
+    redraw = core_apply_pointer(core, time);
+
+  if (core_dwell(core, time))
+    redraw = TRUE;
+
+  return redraw;
+}
+
+/* TRUE while the menu changes without pointer input, the caller should keep
+ * calling fittsmenu_core_advance() */
+gboolean
+fittsmenu_core_is_animating (FittsmenuCore *core)
+{
+  return core->dwell_edge != 0;
+}
+
+static gboolean
+core_apply_pointer (FittsmenuCore *core, gint64 time)
+{
+  gint cx, cy;
+  gdouble rx, ry;
+
+  core->pointer_pending = FALSE;
+
+  cx = core->menu_radius;
+  cy = core->menu_radius;
+
+  ry = (cx - core->pointer_x)*-1;
+  rx = (cy - core->pointer_y);
+
+  recpol(rx,ry, &core->mouse_distance, &core->mouse_angle);
+  core->mouse_angle = core->mouse_angle * (180.0f/G_PI);
+
+  // Left the menu area
+  if ((core->mouse_distance > core->menu_radius)
+      || (core->mouse_distance < core->menu_inner_radius - 10)) {
+    // Save the current position, to ensure when we enter the menu
+    // doesn't jump around
+    if (core->animation == FITTSMENU_ANIM_CROTATE) {
+      core->menu_angle_offset = core->menu_angle;
+      core->menu_angle_diff = 0;
+    }
+    core->menu_over = FALSE;
+    return TRUE;
+  }
+
+  // Enter the menu area
+  if (!core->menu_over) {
+    // Apply the saved position on enter to the current menu angle
+    core->menu_over = TRUE;
+		if (core->animation == FITTSMENU_ANIM_CROTATE) {
+      core->menu_angle_diff = (core->menu_angle_offset + core->mouse_angle)*-1;
+      core->menu_angle_diff = core->menu_angle_diff % 360;
+		}
+  }
+  // calculate the current menu angle based on the mouse angle
+  if (core->animation == FITTSMENU_ANIM_CROTATE)
+  	core->menu_angle = (core->mouse_angle + core->menu_angle_diff)*-1;
+
+  // make sure the menuangle isn't negative or too large
+  core->menu_angle = core->menu_angle % 360;
+  if (core->menu_angle < 0)
+    core->menu_angle = core->menu_angle + 360;
+
+  core->last_update = time;
+  return TRUE;
+}
+
+/* Scroll a data source by one whenever the pointer has rested on the first
+ * or last slice of the window for long enough */
+static gboolean
+core_dwell (FittsmenuCore *core, gint64 time)
+{
+  gint edge, hover_index;
+
+  edge = 0;
+  hover_index = core_hover_index(core);
+  if (core->source_func && hover_index >= 0) {
+    if (hover_index == 0 && core->source_first > 0)
+      edge = -1;
+    else if (hover_index == (gint)core->source_visible - 1
+             && core->source_first + core->source_visible < core->source_items)
+      edge = 1;
+  }
+
+  if (edge != core->dwell_edge) {
+    core->dwell_edge = edge;
+    core->dwell_start = time;
+    return FALSE;
+  }
+
+  if (!edge || time - core->dwell_start < FITTSMENU_DWELL_SCROLL)
+    return FALSE;
+
+  core->dwell_start = time;
+  return fittsmenu_core_scroll(core, edge);
+}
+
+/* The slice under the pointer, -1 when there is none */
+static gint
+core_hover_index (FittsmenuCore *core)
+{
+  if (!core->menu_over)
+    return -1;
+  // Hit test against the ring as drawn
+  return core_index_at(core, core->mouse_angle, core->mouse_distance, core_draw_angle(core));
+}
+
+/* The slice at a mouse angle and distance from the centre with the ring
+ * turned to angle. Slice 0 of each ring starts at angle pointing right while
+ * mouse angles start pointing up. Distances inside the innermost ring or
+ * past the outermost count as that ring. */
+static gint
+core_index_at (FittsmenuCore *core, gdouble mouse_angle, gdouble distance, gint angle)
+{
+  FittsmenuRingGeometry *ring;
+  gdouble rel_angle;
+
+  // Only the rings are needed, not the icons a full layout loads
+  if (!geometry_update_rings(core))
+    return -1;
+
+  // The ring by table lookup, the sector within it by division
+  distance = CLAMP(distance, 0, core->ring_at_size - 1);
+  ring = &core->ring_geometry[core->ring_at[(guint)distance]];
+
+  rel_angle = fmod(mouse_angle - 90 - angle, 360);
+  if (rel_angle < 0)
+    rel_angle = rel_angle + 360;
+  return ring->first + MIN(rel_angle / (360.0 / ring->n_slices), ring->n_slices - 1);
+}
+
+/* Rings */
+void
+fittsmenu_core_set_rings (FittsmenuCore *core, const FittsmenuRing *rings, guint n_rings)
+{
+  FittsmenuRing ring;
+  guint i, j;
+
+  g_free(core->rings);
+  core->n_rings = rings ? MIN(n_rings, G_MAXUINT8) : 0;
+  core->rings = NULL;
+  if (core->n_rings) {
+    core->rings = g_new(FittsmenuRing, core->n_rings);
+    memcpy(core->rings, rings, sizeof(FittsmenuRing) * core->n_rings);
+  }
+
+  // Runs of rings with radii of their own are put in order from the centre
+  // out, keeping the order given when two start together
+  for (i = 1; i < core->n_rings; i++) {
+    ring = core->rings[i];
+    if (ring.outer_radius <= 0)
+      continue;
+    for (j = i; j > 0 && core->rings[j - 1].outer_radius > 0
+                && core->rings[j - 1].inner_radius > ring.inner_radius; j--)
+      core->rings[j] = core->rings[j - 1];
+    core->rings[j] = ring;
+  }
+  geometry_invalidate(core);
+}
+
+guint
+fittsmenu_core_get_n_rings (FittsmenuCore *core)
+{
+  return MAX(core->n_rings, 1);
+}
+
+gint
+fittsmenu_core_get_hover_ring (FittsmenuCore *core)
+{
+  gint hover_index;
+
+  hover_index = core_hover_index(core);
+  if (hover_index < 0)
+    return -1;
+  return geometry_ring_of(core, hover_index) - core->ring_geometry;
+}
+
+gboolean
+fittsmenu_core_get_slice_centre (FittsmenuCore *core, guint index, gdouble *angle,
+                                 gdouble *distance, gdouble *depth, gdouble *span)
+{
+  FittsmenuRingGeometry *ring;
+
+  if (!geometry_update_rings(core))
+    return FALSE;
+  ring = geometry_ring_of(core, index);
+  if (!ring)
+    return FALSE;
+
+  // The inverse of core_index_at() with the ring as drawn
+  if (angle)
+    *angle = fmod(90 + core_draw_angle(core)
+                  + (index - ring->first + 0.5) * 360.0 / ring->n_slices, 360);
+  if (distance)
+    *distance = (ring->inner_edge + ring->outer_edge) / 2;
+  if (depth)
+    *depth = ring->outer_edge - ring->inner_edge;
+  if (span)
+    *span = 360.0 / ring->n_slices;
+  return TRUE;
+}
+
+/* Data sources */
+void
+fittsmenu_core_set_source (FittsmenuCore *core, guint n_items, guint n_visible,
+                           FittsmenuSliceFunc func, gpointer user_data,
+                           GDestroyNotify notify)
+{
+  if (core->source_cache)
+    g_hash_table_destroy(core->source_cache);
+  core->source_cache = NULL;
+  if (core->source_notify)
+    core->source_notify(core->source_data);
+
+  core->source_func = func;
+  core->source_data = user_data;
+  core->source_notify = notify;
+  core->source_items = n_items;
+  core->source_visible = MAX(n_visible, 1);
+  core->source_first = 0;
+  core->dwell_edge = 0;
+
+  if (!func) {
+    core_adopt(core, fittsmenu_snapshot_new(NULL, 0));
+    return;
+  }
+
+  core->source_cache = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                             (GDestroyNotify) fittsmenu_slice_unref);
+  source_update(core);
+}
+
+/* The items behind a data source changed, slices are requested again */
+void
+fittsmenu_core_source_changed (FittsmenuCore *core, guint n_items)
+{
+  g_return_if_fail (core->source_func != NULL);
+
+  g_hash_table_remove_all(core->source_cache);
+  core->source_items = n_items;
+  source_update(core);
+}
+
+/* Move a data source window by delta items, returns TRUE if it moved */
+gboolean
+fittsmenu_core_scroll (FittsmenuCore *core, gint delta)
+{
+  gint first, last;
+
+  if (!core->source_func)
+    return FALSE;
+
+  last = MAX((gint)core->source_items - (gint)core->source_visible, 0);
+  first = CLAMP((gint)core->source_first + delta, 0, last);
+  if (first == (gint)core->source_first)
+    return FALSE;
+
+  core->source_first = first;
+  source_update(core);
+  return TRUE;
+}
+
+guint
+fittsmenu_core_get_first (FittsmenuCore *core)
+{
+  return core->source_first;
+}
+
+/* Show the window at source_first, materializing it and one item either side
+ * and dropping everything further away */
+static void
+source_update (FittsmenuCore *core)
+{
+  fittsmenu_slice **slices;
+  guint i, n_slices;
+
+  n_slices = MIN(core->source_visible, core->source_items);
+  if (core->source_first + n_slices > core->source_items)
+    core->source_first = core->source_items - n_slices;
+
+  slices = g_new(fittsmenu_slice*, n_slices);
+  for (i = 0; i < n_slices; i++)
+    slices[i] = source_get(core, core->source_first + i);
+
+  if (core->source_first > 0)
+    source_get(core, core->source_first - 1);
+  if (core->source_first + n_slices < core->source_items)
+    source_get(core, core->source_first + n_slices);
+
+  g_hash_table_foreach_remove(core->source_cache, source_out_of_window, core);
+
+  core_adopt(core, fittsmenu_snapshot_new(slices, n_slices));
+  g_free(slices);
+}
+
+static fittsmenu_slice*
+source_get (FittsmenuCore *core, guint index)
+{
+  fittsmenu_slice *slice;
+
+  slice = g_hash_table_lookup(core->source_cache, GUINT_TO_POINTER(index));
+  if (!slice) {
+    slice = core->source_func(index, core->source_data);
+    g_hash_table_insert(core->source_cache, GUINT_TO_POINTER(index), slice);
+  }
+  return slice;
+}
+
+static gboolean
+source_out_of_window (gpointer key, gpointer value, gpointer data)
+{
+  FittsmenuCore *core = (FittsmenuCore *)data;
+  guint index = GPOINTER_TO_UINT(key);
+
+  return index + 1 < core->source_first
+         || index > core->source_first + core->source_visible;
+}
+
+/* Everything a frame depends on besides the slices */
+void
+fittsmenu_core_get_state (FittsmenuCore *core, FittsmenuCoreState *state)
+{
+  state->menu_radius = core->menu_radius;
+  state->menu_inner_radius = core->menu_inner_radius;
+  state->menu_angle = core->menu_angle;
+  state->mouse_angle = core->mouse_angle;
+  state->mouse_distance = core->mouse_distance;
+  state->menu_over = core->menu_over;
+  state->first = core->source_first;
+}
+
+/* Take on the pointer and layout of another core, for a core that only draws */
+void
+fittsmenu_core_set_state (FittsmenuCore *core, const FittsmenuCoreState *state)
+{
+  if (state->menu_radius != core->menu_radius)
+    fittsmenu_core_set_menu_radius(core, state->menu_radius);
+  if (state->menu_inner_radius != core->menu_inner_radius)
+    fittsmenu_core_set_menu_inner_radius(core, state->menu_inner_radius);
+  core->menu_angle = state->menu_angle;
+  core->mouse_angle = state->mouse_angle;
+  core->mouse_distance = state->mouse_distance;
+  core->menu_over = state->menu_over;
+  // Slices take their index from this when adopted
+  core->source_first = state->first;
+}
+
+/* Select the slice under the pointer */
+fittsmenu_slice*
+fittsmenu_core_activate (FittsmenuCore *core)
+{
+  gint hover_index;
+
+  // From the pointer rather than the last frame, which may not be ours
+  hover_index = core_hover_index(core);
+  core->hover = hover_index < 0 ? NULL : g_list_nth_data(core->slices, hover_index);
+  // An insensitive slice clears the last pick rather than leaving it active
+  core_set_active(core, core->hover && !core->hover->insensitive ? core->hover : NULL);
+  if (core->active && core->usage_id)
+    usage_record(core, core->active);
+  return core->active;
+}
+
+fittsmenu_slice*
+fittsmenu_core_pick (FittsmenuCore *core)
+{
+  gint hover_index;
+
+  hover_index = core_hover_index(core);
+  return hover_index < 0 ? NULL : g_list_nth_data(core->slices, hover_index);
+}
+
+fittsmenu_slice*
+fittsmenu_core_mark (FittsmenuCore *core, gdouble dx, gdouble dy)
+{
+  fittsmenu_slice *slice;
+  gdouble distance, angle;
+  gint index;
+
+  // Same axes as pointer motion, 0 is up and angles run clockwise
+  recpol(-dy, dx, &distance, &angle);
+  // A direction always means the same slice, however far CROTATE has
+  // turned the ring since
+  index = core_index_at(core, angle * (180.0f/G_PI), distance, core->mark_angle);
+
+  slice = index < 0 ? NULL : g_list_nth_data(core->slices, index);
+  core_set_active(core, slice && !slice->insensitive ? slice : NULL);
+  if (core->active && core->usage_id)
+    usage_record(core, core->active);
+  return core->active;
+}
+
+/* Usage statistics */
+/* A copy, the icon may be replaced by another thread */
+static gchar*
+slice_dup_usage_key (fittsmenu_slice *slice)
+{
+  gchar *key;
+
+  if (slice->label)
+    return g_strdup(slice->label);
+  G_LOCK (slice_state);
+  key = g_strdup(slice->icon ? slice->icon : "");
+  G_UNLOCK (slice_state);
+  return key;
+}
+
+static gchar*
+usage_path (void)
+{
+  return g_build_filename(g_get_user_config_dir(), "libsexier", "fittsmenu-usage", NULL);
+}
+
+static GKeyFile*
+usage_load (void)
+{
+  GKeyFile *usage;
+  gchar *path;
+
+  usage = g_key_file_new();
+  path = usage_path();
+  // A missing file is just a menu that hasn't been used yet
+  g_key_file_load_from_file(usage, path, G_KEY_FILE_NONE, NULL);
+  g_free(path);
+  return usage;
+}
+
+/* Count an activation. It is written out once activations stop for a few
+ * seconds, or when the menu goes. */
+static void
+usage_record (FittsmenuCore *core, fittsmenu_slice *slice)
+{
+  gint *old, usage[2];
+  gchar *key;
+  gsize length;
+
+  key = slice_dup_usage_key(slice);
+  usage[0] = 0;
+  old = g_key_file_get_integer_list(core->usage, core->usage_id, key, &length, NULL);
+  if (old && length == 2)
+    usage[0] = old[0];
+  g_free(old);
+
+  usage[0] = usage[0] + 1;
+  usage[1] = time(NULL) / 3600;
+  g_key_file_set_integer_list(core->usage, core->usage_id, key, usage, 2);
+  g_free(key);
+
+  core->usage_dirty = TRUE;
+  if (core->usage_save_id)
+    g_source_remove(core->usage_save_id);
+  core->usage_save_id = g_timeout_add_seconds(FITTSMENU_USAGE_SAVE_DELAY,
+                                              usage_save_timeout, core);
+}
+
+static gboolean
+usage_save_timeout (gpointer data)
+{
+  FittsmenuCore *core = data;
+
+  core->usage_save_id = 0;
+  usage_save(core);
+  return FALSE;
+}
+
+/* Write this menu's counts if any are waiting. Other menus share the file,
+ * so it is read again and only this menu's group replaced. */
+static void
+usage_save (FittsmenuCore *core)
+{
+  GError *error = NULL;
+  GKeyFile *file;
+  gchar **keys, *path, *dir, *data, *value;
+  gsize length;
+  gint i;
+
+  if (core->usage_save_id)
+    g_source_remove(core->usage_save_id);
+  core->usage_save_id = 0;
+  if (!core->usage_dirty)
+    return;
+  core->usage_dirty = FALSE;
+
+  file = usage_load();
+  g_key_file_remove_group(file, core->usage_id, NULL);
+  keys = g_key_file_get_keys(core->usage, core->usage_id, NULL, NULL);
+  for (i = 0; keys && keys[i]; i++) {
+    value = g_key_file_get_value(core->usage, core->usage_id, keys[i], NULL);
+    g_key_file_set_value(file, core->usage_id, keys[i], value);
+    g_free(value);
+  }
+  g_strfreev(keys);
+
+  path = usage_path();
+  dir = g_path_get_dirname(path);
+  g_mkdir_with_parents(dir, 0700);
+  data = g_key_file_to_data(file, &length, NULL);
+  if (!g_file_set_contents(path, data, length, &error)) {
+    g_printerr("Fittsmenu: %s\n", error->message);
+    g_clear_error(&error);
+  }
+  g_free(data);
+  g_free(dir);
+  g_free(path);
+  g_key_file_free(file);
+}
+
+/* Drawing */
+void
+fittsmenu_core_render (FittsmenuCore *core, cairo_t* cr)
+{
+  cairo_surface_t *sprite;
+  gint angle, hover_index;
+
+  // Per frame temporaries from the last frame are no longer referenced
+  g_string_chunk_clear(core->scratch);
+
+  // Frame boundary, pick up contents published since the last frame
+  fittsmenu_core_sync(core);
+
+  if (!core->geometry_valid && !geometry_update(core))
+    return;
+
+  // Replaced icons make the sprites stale
+  core_apply_damage(core);
+
+  angle = core_draw_angle(core);
+  hover_index = core_hover_index(core);
+  sprite = sprite_get(core, angle, cairo_get_target(cr));
+
+  cairo_save(cr);
+  if (!sprite)
+    core->hover = core_draw_ring(core, cr, angle, hover_index);
+  else
+    core->hover = core_blit_ring(core, cr, sprite, angle, hover_index);
+  cairo_restore(cr);
+
+  // Previews, badges and progress change on their own, so they are never
+  // in a sprite
+  core_draw_preview(core, cr);
+  core_draw_status(core, cr, angle);
+}
+
+/* Previews */
+void
+fittsmenu_core_set_preview (FittsmenuCore *core, cairo_surface_t *surface)
+{
+  cairo_surface_t *old;
+
+  g_return_if_fail(!surface || cairo_surface_get_type (surface) == CAIRO_SURFACE_TYPE_IMAGE);
+
+  if (surface)
+    cairo_surface_reference(surface);
+  G_LOCK (preview);
+  old = core->preview;
+  core->preview = surface;
+  G_UNLOCK (preview);
+  if (old)
+    cairo_surface_destroy(old);
+}
+
+/* The disc within the innermost slice outlines and their stroke */
+gint
+fittsmenu_core_get_preview_size (FittsmenuCore *core)
+{
+  return MAX(core->menu_inner_radius - 14, 0) * 2;
+}
+
+/* The preview fitted into the centre disc and clipped to it */
+static void
+core_draw_preview (FittsmenuCore *core, cairo_t *cr)
+{
+  cairo_surface_t *preview;
+  gdouble radius, scale;
+  gint width, height;
+
+  G_LOCK (preview);
+  preview = core->preview ? cairo_surface_reference(core->preview) : NULL;
+  G_UNLOCK (preview);
+  if (!preview)
+    return;
+
+  radius = fittsmenu_core_get_preview_size(core) / 2;
+  width = cairo_image_surface_get_width (preview);
+  height = cairo_image_surface_get_height (preview);
+
+  if (radius > 0 && width > 0 && height > 0) {
+    // Corners of the picture touch the edge of the disc
+    scale = 2 * radius / sqrt(width * width + height * height);
+
+    cairo_save(cr);
+    cairo_translate(cr, core->menu_radius, core->menu_radius);
+    cairo_new_path(cr);
+    cairo_arc(cr, 0, 0, radius, 0, 2 * G_PI);
+    cairo_clip(cr);
+    cairo_scale(cr, scale, scale);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+    cairo_set_source_surface(cr, preview, -width / 2.0, -height / 2.0);
+    cairo_paint(cr);
+    cairo_restore(cr);
+  }
+  cairo_surface_destroy(preview);
+}
+
+/* The ring from a sprite, with the hovered sector and the neighbours
+ * showing their full icons drawn over it. Returns the hovered slice. */
+static fittsmenu_slice*
+core_blit_ring (FittsmenuCore *core, cairo_t *cr, cairo_surface_t *sprite,
+                gint angle, gint hover_index)
+{
+  fittsmenu_slice *hover;
+  cairo_matrix_t base;
+  gint detail[3];
+  guint i, n_detail;
+
+  // The ring without hover is a single blit, only the hovered sector and
+  // the neighbours showing their full icons are drawn
+  n_detail = core_detail_slices(core, hover_index, detail);
+  cairo_save(cr);
+  if (n_detail) {
+    cairo_rectangle(cr, 0, 0, core->menu_radius * 2, core->menu_radius * 2);
+    cairo_save(cr);
+    cairo_translate(cr, core->menu_radius, core->menu_radius);
+    cairo_rotate(cr, angle * (G_PI / 180.0));
+    for (i = 0; i < n_detail; i++)
+      cairo_append_path(cr, core->geometry[detail[i]].path);
+    cairo_restore(cr);
+    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_EVEN_ODD);
+    cairo_clip(cr);
+  }
+  if (!core->overlay)
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface(cr, sprite, 0.0, 0.0);
+  cairo_paint(cr);
+  cairo_restore(cr);
+
+  hover = NULL;
+  if (n_detail) {
+    if (!core->overlay)
+      cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    cairo_translate(cr, core->menu_radius, core->menu_radius);
+    cairo_get_matrix(cr, &base);
+    hover = g_list_nth_data(core->slices, hover_index);
+    for (i = 0; i < n_detail; i++)
+      core_draw_slice(core, cr, &base, angle, detail[i],
+                      g_list_nth_data(core->slices, detail[i]),
+                      detail[i] == hover_index, TRUE);
+    core_draw_details(core, cr, &base, angle, hover_index, detail, n_detail);
+  }
+  return hover;
+}
+
+/* Draw the ring turned by angle degrees, returns the hovered slice */
+static fittsmenu_slice*
+core_draw_ring (FittsmenuCore *core, cairo_t *cr, gint angle, gint hover_index)
+{
+  cairo_matrix_t base;
+  fittsmenu_slice *hover;
+  GList *list;
+  gdouble clip[4];
+  gint i, detail[3];
+  guint j, n_detail;
+  gboolean in_detail;
+
+  // Redraws of a few changed slices are clipped to them, the rest is skipped
+  cairo_clip_extents(cr, &clip[0], &clip[1], &clip[2], &clip[3]);
+
+  // Draw the centre of the menu
+  cairo_arc (cr, core->menu_radius, core->menu_radius, core->menu_inner_radius- 10, 0., 2*G_PI);
+  cairo_set_source_rgba(cr, 0, 0, 0, .65);
+  cairo_fill(cr);
+  // Overlays are composited over the host's own drawing
+  if (!core->overlay)
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+
+  // Cached geometry is relative to the centre, the ring is rotated on top
+  cairo_translate(cr, core->menu_radius, core->menu_radius);
+  cairo_get_matrix(cr, &base);
+
+  n_detail = core_detail_slices(core, hover_index, detail);
+  hover = NULL;
+  for (i = 0, list = core->slices; list; i++, list = list->next) {
+    if (i == hover_index)
+      hover = (fittsmenu_slice *)list->data;
+    if (!core_slice_in_clip(core, i, angle, clip))
+      continue;
+    for (j = 0, in_detail = FALSE; j < n_detail; j++)
+      in_detail = in_detail || detail[j] == i;
+    core_draw_slice(core, cr, &base, angle, i, list->data, i == hover_index, in_detail);
+  }
+
+  // Full icons go over the small ones either side of them
+  core_draw_details(core, cr, &base, angle, hover_index, detail, n_detail);
+  return hover;
+}
+
+/* Badges and progress bars of the slices that have them, over the ring */
+static void
+core_draw_status (FittsmenuCore *core, cairo_t *cr, gint angle)
+{
+  FittsmenuSliceGeometry *geom;
+  fittsmenu_slice *slice;
+  cairo_text_extents_t extents;
+  const gchar *badge;
+  gdouble clip[4], progress, start, x, y, radius, width;
+  GList *list;
+  gint i;
+
+  cairo_save(cr);
+  cairo_clip_extents(cr, &clip[0], &clip[1], &clip[2], &clip[3]);
+  cairo_translate(cr, core->menu_radius, core->menu_radius);
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+  for (i = 0, list = core->slices; list; i++, list = list->next) {
+    slice = (fittsmenu_slice *)list->data;
+
+    // Copied out, another thread may change them meanwhile
+    G_LOCK (slice_state);
+    badge = slice->badge ? g_string_chunk_insert(core->scratch, slice->badge) : NULL;
+    progress = slice->progress;
+    G_UNLOCK (slice_state);
+
+    if ((!badge && progress < 0) || !core_slice_in_clip(core, i, angle, clip))
+      continue;
+    geom = &core->geometry[i];
+
+    // Progress runs clockwise just inside the outer edge
+    if (progress >= 0) {
+      start = geom->angle_start + angle * (G_PI / 180.0);
+      radius = core->ring_geometry[geom->ring].outer_radius - 7;
+      cairo_new_path(cr);
+      cairo_arc(cr, 0, 0, radius, start,
+                start + (geom->angle_end - geom->angle_start) * progress);
+      cairo_set_line_width(cr, 3);
+      cairo_set_source_rgba(cr, 1, 1, 1, .8);
+      cairo_stroke(cr);
+    }
+
+    if (!badge)
+      continue;
+
+    // Badges sit upright on the top right corner of the icon or marker
+    x = geom->icon_x * angle_cos[angle] - geom->icon_y * angle_sin[angle];
+    y = geom->icon_x * angle_sin[angle] + geom->icon_y * angle_cos[angle];
+    x += geom->icon_scale ? geom->icon_offset_x : geom->marker_size / 2;
+    y -= geom->icon_scale ? geom->icon_offset_y : geom->marker_size / 2;
+
+    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+    cairo_set_font_size(cr, 9);
+    cairo_text_extents(cr, badge, &extents);
+
+    // A circle for a digit, stretched into a pill for longer text
+    radius = 7;
+    width = MAX(extents.width - radius, 0);
+    cairo_new_path(cr);
+    cairo_arc(cr, x + width / 2, y, radius, -G_PI / 2, G_PI / 2);
+    cairo_arc(cr, x - width / 2, y, radius, G_PI / 2, 3 * G_PI / 2);
+    cairo_close_path(cr);
+    cairo_set_source_rgba(cr, .8, .1, .1, .9);
+    cairo_fill(cr);
+
+    cairo_move_to(cr, x - extents.x_bearing - extents.width / 2,
+                      y - extents.y_bearing - extents.height / 2);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_show_text(cr, badge);
+  }
+  cairo_restore(cr);
+}
+
+/* Circle around slice i with the ring turned by angle degrees, in menu
+ * co-ordinates */
+static void
+core_slice_bound (FittsmenuCore *core, gint i, gint angle,
+                  gdouble *x, gdouble *y, gdouble *radius)
+{
+  FittsmenuSliceGeometry *geom;
+
+  geom = &core->geometry[i];
+  *x = core->menu_radius + geom->bound_x * angle_cos[angle] - geom->bound_y * angle_sin[angle];
+  *y = core->menu_radius + geom->bound_x * angle_sin[angle] + geom->bound_y * angle_cos[angle];
+  *radius = geom->bound_radius;
+}
+
+/* Whether slice i reaches into clip, x1, y1, x2, y2 in menu co-ordinates */
+static gboolean
+core_slice_in_clip (FittsmenuCore *core, gint i, gint angle, const gdouble *clip)
+{
+  gdouble x, y, radius;
+
+  core_slice_bound(core, i, angle, &x, &y, &radius);
+  return x + radius > clip[0] && x - radius < clip[2]
+      && y + radius > clip[1] && y - radius < clip[3];
+}
+
+/* Slices drawn in full detail, the hovered one and, when the ring is too
+ * crowded for icons, its neighbours. Returns how many there are. */
+static guint
+core_detail_slices (FittsmenuCore *core, gint hover_index, gint *detail)
+{
+  FittsmenuRingGeometry *ring;
+  guint count, k;
+  gint d, j;
+
+  if (hover_index < 0)
+    return 0;
+
+  count = 0;
+  detail[count++] = hover_index;
+  if (core->geometry[hover_index].lod == FITTSMENU_LOD_ICON)
+    return count;
+
+  // Neighbours wrap around within the hovered slice's ring
+  ring = &core->ring_geometry[core->geometry[hover_index].ring];
+  for (d = -1; d <= 1; d += 2) {
+    j = ring->first + (hover_index - ring->first + d + ring->n_slices) % ring->n_slices;
+    for (k = 0; k < count && detail[k] != j; k++);
+    if (k == count)
+      detail[count++] = j;
+  }
+  return count;
+}
+
+/* Full icons of the detail slices that are drawn as markers otherwise */
+static void
+core_draw_details (FittsmenuCore *core, cairo_t *cr, const cairo_matrix_t *base,
+                   gint angle, gint hover_index, const gint *detail, guint n_detail)
+{
+  guint i;
+
+  for (i = 0; i < n_detail; i++) {
+    if (core->geometry[detail[i]].lod == FITTSMENU_LOD_ICON)
+      continue;
+    core_draw_icon(core, cr, base, angle, detail[i],
+                   g_list_nth_data(core->slices, detail[i]),
+                   detail[i] == hover_index);
+  }
+}
+
+/* Draw the outline of slice i and, unless the caller draws it in detail, its
+ * icon or the marker standing in for it. base is the centre of the menu. */
+static void
+core_draw_slice (FittsmenuCore *core, cairo_t *cr, const cairo_matrix_t *base,
+                 gint angle, gint i, fittsmenu_slice *slice, gboolean hovered,
+                 gboolean detail)
+{
+  FittsmenuSliceGeometry *geom;
+  FittsmenuSliceStyle *style;
+  cairo_matrix_t ring;
+  gint state;
+
+  geom = &core->geometry[i];
+  cairo_matrix_init(&ring, angle_cos[angle], angle_sin[angle],
+                    -angle_sin[angle], angle_cos[angle], 0, 0);
+  cairo_matrix_multiply(&ring, &ring, base);
+
+  // Replay the slice outline
+  cairo_set_matrix(cr, &ring);
+  cairo_new_path(cr);
+  cairo_append_path(cr, geom->path);
+
+  // Fill and stroke each segment, patterns are centred on the menu so the
+  // rotation doesn't change them
+  state = core_slice_state(core, slice, hovered);
+  style = &core->styles[state];
+  cairo_set_source(cr, core_style_fill(core, state));
+  if (style->stroke_width > 0) {
+    cairo_fill_preserve(cr);
+    cairo_set_source_rgba(cr, style->stroke[0], style->stroke[1],
+                          style->stroke[2], style->stroke[3]);
+    cairo_set_line_width(cr, style->stroke_width);
+    cairo_stroke(cr);
+  } else {
+    cairo_fill(cr);
+  }
+  cairo_set_matrix(cr, base);
+
+  if (geom->lod == FITTSMENU_LOD_ICON)
+    core_draw_icon(core, cr, base, angle, i, slice, hovered);
+  else if (!detail)
+    core_draw_marker(core, cr, angle, slice, geom, hovered);
+}
+
+/* Draw the icon of slice i, loading it first if it was left out of the
+ * layout for being too small */
+static void
+core_draw_icon (FittsmenuCore *core, cairo_t *cr, const cairo_matrix_t *base,
+                gint angle, gint i, fittsmenu_slice *slice, gboolean hovered)
+{
+  FittsmenuSliceGeometry *geom;
+  gdouble icon_x, icon_y;
+  cairo_surface_t *buffer;
+  gint buffer_width, buffer_height;
+  gdouble tint[4];
+  gboolean fresh;
+
+  geom = &core->geometry[i];
+
+  // Replaced since it was laid out, loaded again at the same size
+  if (!geom->icon_pending && geom->icon_serial != g_atomic_int_get(&slice->icon_serial)) {
+    geom->icon_scale = 0;
+    geom->icon_pending = TRUE;
+  }
+  if (geom->icon_pending) {
+    geom->icon_pending = FALSE;
+    if (slice_load_icon(core, slice, geom))
+      geometry_place_icon(core, slice, geom,
+                          geom->lod == FITTSMENU_LOD_ICON ? geom->marker_size
+                                                          : core->lod_icon_min);
+  }
+  if (!geom->icon_scale)
+    return;
+
+  cairo_set_matrix(cr, base);
+
+  // Icons stay upright, only their anchor follows the ring
+  icon_x = geom->icon_x * angle_cos[angle] - geom->icon_y * angle_sin[angle];
+  icon_y = geom->icon_x * angle_sin[angle] + geom->icon_y * angle_cos[angle];
+
+  // Render the current icon
+  cairo_save (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+  cairo_translate (cr, icon_x - geom->icon_offset_x, icon_y - geom->icon_offset_y);
+
+  // Held for the paint, another menu may evict it meanwhile
+  buffer = raster_get(slice, &buffer_width, &buffer_height);
+  fresh = !buffer;
+  if (fresh) {
+    /* Fill buffer on first render */
+    slice_rasterize(core, cr, slice, geom);
+    buffer = raster_get(slice, &buffer_width, &buffer_height);
+  }
+
+  if (buffer) {
+    // Buffers are at natural size for SVGs and at drawn size otherwise
+    cairo_scale (cr, geom->icon_width * geom->icon_scale / buffer_width,
+                     geom->icon_height * geom->icon_scale / buffer_height);
+    if (cairo_surface_get_content (buffer) == CAIRO_CONTENT_ALPHA) {
+      // Monochrome icons are only a mask, coloured for the slice's state
+      core_icon_tint(core, slice, core_slice_state(core, slice, hovered), tint);
+      cairo_set_source_rgba (cr, tint[0], tint[1], tint[2], tint[3]);
+      cairo_mask_surface (cr, buffer, 0.0, 0.0);
+    } else {
+      cairo_set_source_surface (cr, buffer, 0.0, 0.0);
+      // Colour icons of disabled slices are faded instead of tinted
+      if (slice->insensitive && !core->tint_set[FITTSMENU_STATE_DISABLED])
+        cairo_paint_with_alpha (cr, .4);
+      else
+        cairo_paint (cr);
+    }
+    cairo_surface_destroy (buffer);
+    if (fresh)
+      raster_enforce_budget(slice);
+  }
+  cairo_restore (cr);
+}
+
+/* The style a slice is drawn in */
+static gint
+core_slice_state (FittsmenuCore *core, fittsmenu_slice *slice, gboolean hovered)
+{
+  if (slice->insensitive)
+    return FITTSMENU_STATE_DISABLED;
+  if (hovered)
+    return FITTSMENU_STATE_HOVER;
+  if (slice == core->active)
+    return FITTSMENU_STATE_ACTIVE;
+  return FITTSMENU_STATE_NORMAL;
+}
+
+/* The fill of a state, compiled once into a pattern and kept until the
+ * style or the radii change */
+static cairo_pattern_t*
+core_style_fill (FittsmenuCore *core, gint state)
+{
+  FittsmenuSliceStyle *style;
+  cairo_pattern_t *pattern;
+
+  if (core->style_fills[state])
+    return core->style_fills[state];
+
+  style = &core->styles[state];
+  if (!memcmp(style->fill_inner, style->fill_outer, sizeof (style->fill_inner))) {
+    pattern = cairo_pattern_create_rgba(style->fill_inner[0], style->fill_inner[1],
+                                        style->fill_inner[2], style->fill_inner[3]);
+  } else {
+    // Slices run from inner - 10 out to radius - 3
+    pattern = cairo_pattern_create_radial(0, 0, MAX(core->menu_inner_radius - 10, 0),
+                                          0, 0, core->menu_radius - 3);
+    cairo_pattern_add_color_stop_rgba(pattern, 0, style->fill_inner[0], style->fill_inner[1],
+                                      style->fill_inner[2], style->fill_inner[3]);
+    cairo_pattern_add_color_stop_rgba(pattern, 1, style->fill_outer[0], style->fill_outer[1],
+                                      style->fill_outer[2], style->fill_outer[3]);
+  }
+
+  core->style_fills[state] = pattern;
+  return pattern;
+}
+
+/* Drop compiled fills, they are rebuilt on the next frame */
+static void
+core_styles_changed (FittsmenuCore *core)
+{
+  gint i;
+
+  for (i = 0; i < FITTSMENU_STATE_LAST; i++) {
+    if (core->style_fills[i])
+      cairo_pattern_destroy(core->style_fills[i]);
+    core->style_fills[i] = NULL;
+  }
+  sprites_clear(core);
+}
+
+/* Slice styles */
+void
+fittsmenu_core_set_slice_style (FittsmenuCore *core, gint state,
+                                const FittsmenuSliceStyle *style)
+{
+  g_return_if_fail (state >= 0 && state < FITTSMENU_STATE_LAST);
+
+  if (style)
+    core->styles[state] = *style;
+  else
+    core->styles[state] = default_styles[state];
+  core_styles_changed(core);
+}
+
+void
+fittsmenu_core_get_slice_style (FittsmenuCore *core, gint state,
+                                FittsmenuSliceStyle *style)
+{
+  g_return_if_fail (state >= 0 && state < FITTSMENU_STATE_LAST);
+
+  *style = core->styles[state];
+}
+
+/* Stand in for an icon too small to make out: the label's first letter, a
+ * swatch in a colour made up from the slice, or a dot. Nothing is loaded. */
+static void
+core_draw_marker (FittsmenuCore *core, cairo_t *cr, gint angle,
+                  fittsmenu_slice *slice, FittsmenuSliceGeometry *geom,
+                  gboolean hovered)
+{
+  cairo_text_extents_t extents;
+  gdouble x, y, size, rgba[4];
+  gchar glyph[7];
+  gint lod, length;
+
+  x = geom->icon_x * angle_cos[angle] - geom->icon_y * angle_sin[angle];
+  y = geom->icon_x * angle_sin[angle] + geom->icon_y * angle_cos[angle];
+  size = geom->marker_size;
+
+  // Markers are drawn in the icon tints, or a light grey
+  core_marker_colour(core, core_slice_state(core, slice, hovered), rgba);
+
+  lod = geom->lod;
+  if (lod == FITTSMENU_LOD_GLYPH && (!slice->label || !*slice->label))
+    lod = FITTSMENU_LOD_SWATCH;
+
+  cairo_save (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+  switch (lod) {
+    case FITTSMENU_LOD_GLYPH:
+      length = g_unichar_to_utf8(g_unichar_toupper(g_utf8_get_char(slice->label)), glyph);
+      glyph[length] = '\0';
+      cairo_select_font_face (cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+      cairo_set_font_size (cr, size);
+      cairo_text_extents (cr, glyph, &extents);
+      cairo_move_to (cr, x - extents.x_bearing - extents.width / 2,
+                         y - extents.y_bearing - extents.height / 2);
+      cairo_set_source_rgba (cr, rgba[0], rgba[1], rgba[2], rgba[3]);
+      cairo_show_text (cr, glyph);
+      break;
+    case FITTSMENU_LOD_SWATCH:
+      slice_swatch_colour(slice, rgba);
+      cairo_rectangle (cr, x - size / 2, y - size / 2, size, size);
+      cairo_set_source_rgba (cr, rgba[0], rgba[1], rgba[2], hovered ? 1.0 : .8);
+      cairo_fill (cr);
+      break;
+    default:
+      cairo_arc (cr, x, y, MAX(size / 3, 1.5), 0., 2*G_PI);
+      cairo_set_source_rgba (cr, rgba[0], rgba[1], rgba[2], rgba[3]);
+      cairo_fill (cr);
+      break;
+  }
+  cairo_restore (cr);
+}
+
+static void
+core_marker_colour (FittsmenuCore *core, gint tint, gdouble *rgba)
+{
+  if (!core->tint_set[tint])
+    tint = FITTSMENU_STATE_NORMAL;
+
+  if (core->tint_set[tint]) {
+    memcpy(rgba, core->tints[tint], sizeof (core->tints[tint]));
+    return;
+  }
+
+  rgba[0] = rgba[1] = rgba[2] = .9;
+  rgba[3] = .8;
+}
+
+/* A colour that stays the same for a slice from run to run, from its icon
+ * path or label */
+static void
+slice_swatch_colour (fittsmenu_slice *slice, gdouble *rgb)
+{
+  gdouble hue, f, v, p, q, t;
+
+  G_LOCK (slice_state);
+  hue = g_str_hash(slice->icon ? slice->icon : slice->label ? slice->label : "") % 360 / 60.0;
+  G_UNLOCK (slice_state);
+  f = hue - floor(hue);
+  v = .85;
+  p = v * (1 - .55);
+  q = v * (1 - .55 * f);
+  t = v * (1 - .55 * (1 - f));
+
+  switch ((gint)hue) {
+    case 0:  rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+    case 1:  rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+    case 2:  rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+    case 3:  rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+    case 4:  rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+    default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break;
+  }
+}
+
+/* The angle the ring is drawn at, menu_angle rounded to the nearest cached
+ * angle when there is a sprite cache */
+static gint
+core_draw_angle (FittsmenuCore *core)
+{
+  gint angle;
+
+  angle = core->menu_angle % 360;
+  if (angle < 0)
+    angle = angle + 360;
+
+  if (!core->sprite_angles)
+    return angle;
+  return sprite_angle(core, sprite_index(core, angle));
+}
+
+/* Level of detail */
+void
+fittsmenu_core_set_lod_sizes (FittsmenuCore *core, gint icon_min, gint glyph_min,
+                              gint swatch_min)
+{
+  core->lod_icon_min = icon_min;
+  core->lod_glyph_min = glyph_min;
+  core->lod_swatch_min = swatch_min;
+  geometry_invalidate(core);
+}
+
+/* Remote displays */
+void
+fittsmenu_core_set_remote (FittsmenuCore *core, gboolean value)
+{
+  // Sprites drawn for the other kind of display
+  core->remote = value;
+  sprites_clear(core);
+}
+
+gboolean
+fittsmenu_core_get_remote (FittsmenuCore *core)
+{
+  return core->remote;
+}
+
+/* Sprite cache */
+void
+fittsmenu_core_set_sprite_cache (FittsmenuCore *core, guint n_angles, gsize max_bytes)
+{
+  sprites_clear(core);
+  g_free(core->sprites);
+
+  core->sprite_angles = MIN(n_angles, 360);
+  core->sprite_max = max_bytes;
+  core->sprites = core->sprite_angles ? g_new0(cairo_surface_t *, core->sprite_angles) : NULL;
+}
+
+gsize
+fittsmenu_core_get_sprite_bytes (FittsmenuCore *core)
+{
+  return core->sprite_bytes;
+}
+
+/* Draw one sprite that isn't cached yet, returns FALSE once there is nothing
+ * left to draw or no room left to keep it */
+gboolean
+fittsmenu_core_prerender (FittsmenuCore *core)
+{
+  guint i;
+
+  fittsmenu_core_sync(core);
+  // Remote sprites live next to the target, there is none to draw them for
+  if (core->remote)
+    return FALSE;
+  if (!core->sprite_angles || (!core->geometry_valid && !geometry_update(core)))
+    return FALSE;
+
+  for (i = 0; i < core->sprite_angles; i++) {
+    if (core->sprites[i])
+      continue;
+    return sprite_get(core, sprite_angle(core, i), NULL) != NULL;
+  }
+  return FALSE;
+}
+
+static guint
+sprite_index (FittsmenuCore *core, gint angle)
+{
+  return ((angle * core->sprite_angles + 180) / 360) % core->sprite_angles;
+}
+
+static gint
+sprite_angle (FittsmenuCore *core, guint index)
+{
+  return index * 360 / core->sprite_angles;
+}
+
+/* The ring at a cached angle, drawn on first use. NULL without a cache or
+ * when the sprite would take the cache over its ceiling. Remote menus draw
+ * it similar to target, a server side Picture for xlib targets. */
+static cairo_surface_t*
+sprite_get (FittsmenuCore *core, gint angle, cairo_surface_t *target)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  guint index;
+  gsize bytes;
+  gint size;
+
+  if (!core->sprite_angles)
+    return NULL;
+
+  index = sprite_index(core, angle);
+  if (core->sprites[index])
+    return core->sprites[index];
+
+  size = core->menu_radius * 2;
+  bytes = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, size) * size;
+  if (core->sprite_max && core->sprite_bytes + bytes > core->sprite_max)
+    return NULL;
+
+  if (core->remote && target)
+    surface = cairo_surface_create_similar(target, CAIRO_CONTENT_COLOR_ALPHA, size, size);
+  else
+    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+  cr = cairo_create(surface);
+  cairo_set_tolerance(cr, 0.1);
+  core_draw_ring(core, cr, angle, -1);
+  cairo_destroy(cr);
+
+  core->sprites[index] = surface;
+  core->sprite_bytes += bytes;
+  return surface;
+}
+
+/* Drop every sprite, the slices or their layout changed */
+static void
+sprites_clear (FittsmenuCore *core)
+{
+  guint i;
+
+  for (i = 0; i < core->sprite_angles; i++) {
+    if (core->sprites[i])
+      cairo_surface_destroy(core->sprites[i]);
+    core->sprites[i] = NULL;
+  }
+  core->sprite_bytes = 0;
+}
+
+void
+fittsmenu_core_ring_path (FittsmenuCore *core, cairo_t *cr)
+{
+  cairo_surface_t *preview;
+  gdouble cx, cy, outer, inner, radius, scale;
+  gint width, height;
+  guint r;
+
+  cx = core->menu_radius;
+  cy = core->menu_radius;
+
+  // Slice outlines plus half their stroke
+  outer = core->menu_radius - 1;
+  inner = core->menu_inner_radius - 12;
+  if (core->geometry_valid || geometry_update(core)) {
+    outer = 0;
+    inner = core->menu_radius;
+    for (r = 0; r < core->ring_count; r++) {
+      outer = MAX(outer, core->ring_geometry[r].outer_edge + 2);
+      inner = MIN(inner, core->ring_geometry[r].inner_edge - 2);
+    }
+  }
+
+  cairo_new_sub_path(cr);
+  cairo_arc(cr, cx, cy, outer, 0., 2*G_PI);
+  cairo_new_sub_path(cr);
+  cairo_arc(cr, cx, cy, MAX(inner, 0), 0., 2*G_PI);
+
+  // The preview sits in the hole, as drawn by core_draw_preview()
+  G_LOCK (preview);
+  preview = core->preview ? cairo_surface_reference(core->preview) : NULL;
+  G_UNLOCK (preview);
+  if (!preview)
+    return;
+
+  radius = fittsmenu_core_get_preview_size(core) / 2;
+  width = cairo_image_surface_get_width (preview);
+  height = cairo_image_surface_get_height (preview);
+  if (radius > 0 && width > 0 && height > 0) {
+    scale = 2 * radius / sqrt(width * width + height * height);
+    cairo_rectangle(cr, cx - width * scale / 2, cy - height * scale / 2,
+                    width * scale, height * scale);
+  }
+  cairo_surface_destroy(preview);
+}
+
+/* Load the icon handle of a slice and find its natural size, returns FALSE
+ * if neither the icon nor the missing icon could be loaded */
+static gboolean
+slice_load_icon (FittsmenuCore *core, fittsmenu_slice *slice,
+                 FittsmenuSliceGeometry *geom)
+{
+  gboolean loaded;
+
+  G_LOCK (slice_state);
+  geom->icon_serial = slice->icon_serial;
+  loaded = slice_load_icon_unlocked(core, slice, geom);
+  G_UNLOCK (slice_state);
+  return loaded;
+}
+
+static gboolean
+slice_load_icon_unlocked (FittsmenuCore *core, fittsmenu_slice *slice,
+                          FittsmenuSliceGeometry *geom)
+{
+  RsvgDimensionData icon_size = { 0, 0, 0.0, 0.0 };
+  GError *iconerror = NULL;
+  gsize icon_len;
+
+  // Icons held in memory are never swapped for a file
+  if (slice->icon_surface) {
+    geom->icon_svg = FALSE;
+    geom->icon_width = cairo_image_surface_get_width (slice->icon_surface);
+    geom->icon_height = cairo_image_surface_get_height (slice->icon_surface);
+    return TRUE;
+  }
+  if (slice->icon_pixbuf) {
+    geom->icon_svg = FALSE;
+    geom->icon_width = gdk_pixbuf_get_width (slice->icon_pixbuf);
+    geom->icon_height = gdk_pixbuf_get_height (slice->icon_pixbuf);
+    return TRUE;
+  }
+  if (slice->icon_data)
+    return slice_load_data(slice, geom);
+
+  // Compared in place, hit testing loads icons too and never clears scratch
+  icon_len = strlen(slice->icon);
+  geom->icon_svg = icon_len >= 4 &&
+                   !g_ascii_strcasecmp(slice->icon + icon_len - 4, ".svg");
+
+  if (!geom->icon_svg) {
+    // Only the header is read, pixels are decoded at the drawn size later
+    if (gdk_pixbuf_get_file_info (slice->icon, &geom->icon_width, &geom->icon_height))
+      return TRUE;
+
+    g_printerr("GdkPixbuf: unrecognised image %s\n", slice->icon);
+    if (!core->missing_icon)
+      return FALSE;
+
+    if (!slice->icon_static)
+      g_free(slice->icon);
+    slice->icon = g_strdup(core->missing_icon);
+    slice->icon_static = FALSE;
+    geom->icon_svg = TRUE;
+  }
+
+  // The handle is loaded once and owned by the slice
+  if (!slice->icon_handle)
+    slice->icon_handle = rsvg_handle_new_from_file (slice->icon, &iconerror);
+  if (iconerror != NULL) {
+    g_printerr("RSVG: %s %s\n", iconerror->message, slice->icon);
+    g_clear_error(&iconerror);
+
+    // Load the default missing icon instead
+    if (!core->missing_icon)
+      return FALSE;
+
+    if (!slice->icon_static)
+      g_free(slice->icon);
+    slice->icon = g_strdup(core->missing_icon);
+    slice->icon_static = FALSE;
+    slice->icon_handle = rsvg_handle_new_from_file (slice->icon, &iconerror);
+
+    if (iconerror != NULL) {
+      g_printerr("RSVG: %s\n", iconerror->message);
+      g_clear_error(&iconerror);
+      return FALSE;
+    }
+  }
+
+  rsvg_handle_get_dimensions(slice->icon_handle, &icon_size);
+  geom->icon_width = icon_size.width;
+  geom->icon_height = icon_size.height;
+  return TRUE;
+}
+
+/* Load an icon held in memory, SVGs are told apart by their contents */
+static gboolean
+slice_load_data (fittsmenu_slice *slice, FittsmenuSliceGeometry *geom)
+{
+  RsvgDimensionData icon_size = { 0, 0, 0.0, 0.0 };
+  GError *error = NULL;
+  gconstpointer data;
+  gsize size;
+
+  geom->icon_svg = data_is_svg(slice->icon_data);
+  if (!geom->icon_svg) {
+    if (data_get_info(slice->icon_data, &geom->icon_width, &geom->icon_height))
+      return TRUE;
+    g_printerr("GdkPixbuf: unrecognised image data\n");
+    return FALSE;
+  }
+
+  if (!slice->icon_handle) {
+    data = g_bytes_get_data(slice->icon_data, &size);
+    slice->icon_handle = rsvg_handle_new_from_data (data, size, &error);
+  }
+  if (!slice->icon_handle) {
+    g_printerr("RSVG: %s\n", error->message);
+    g_clear_error(&error);
+    return FALSE;
+  }
+
+  rsvg_handle_get_dimensions(slice->icon_handle, &icon_size);
+  geom->icon_width = icon_size.width;
+  geom->icon_height = icon_size.height;
+  return TRUE;
+}
+
+/* Whether an icon in memory is an SVG. Sniffed here rather than through the
+ * shared MIME database, which would be read from disk. */
+static gboolean
+data_is_svg (GBytes *bytes)
+{
+  const gchar *data;
+  gsize size;
+
+  data = g_bytes_get_data(bytes, &size);
+  return g_strstr_len(data, MIN(size, 4096), "<svg") != NULL;
+}
+
+static void
+data_size_prepared (GdkPixbufLoader *loader, gint width, gint height, gpointer user_data)
+{
+  gint *natural = user_data;
+
+  natural[0] = width;
+  natural[1] = height;
+  // Only the size is wanted, decode as little as possible
+  gdk_pixbuf_loader_set_size (loader, 1, 1);
+}
+
+/* Natural size of an encoded image in memory, like gdk_pixbuf_get_file_info()
+ * it stops feeding the loader once the header is read */
+static gboolean
+data_get_info (GBytes *bytes, gint *width, gint *height)
+{
+  GdkPixbufLoader *loader;
+  const guchar *data;
+  gsize size, offset, chunk;
+  gint natural[2] = { 0, 0 };
+
+  data = g_bytes_get_data(bytes, &size);
+  loader = gdk_pixbuf_loader_new ();
+  g_signal_connect (loader, "size-prepared", G_CALLBACK (data_size_prepared), natural);
+  for (offset = 0; offset < size && !natural[0]; offset += chunk) {
+    chunk = MIN(size - offset, 4096);
+    if (!gdk_pixbuf_loader_write (loader, data + offset, chunk, NULL))
+      break;
+  }
+  gdk_pixbuf_loader_close (loader, NULL);
+  g_object_unref (loader);
+
+  *width = natural[0];
+  *height = natural[1];
+  return natural[0] > 0 && natural[1] > 0;
+}
+
+/* Decode a non SVG icon at width by height, from wherever it is held */
+static GdkPixbuf*
+slice_decode (fittsmenu_slice *slice, gint width, gint height, GError **error)
+{
+  GInputStream *stream;
+  GdkPixbuf *pixbuf;
+
+  if (slice->icon_pixbuf) {
+    if (gdk_pixbuf_get_width (slice->icon_pixbuf) == width
+        && gdk_pixbuf_get_height (slice->icon_pixbuf) == height)
+      return g_object_ref (slice->icon_pixbuf);
+    return gdk_pixbuf_scale_simple (slice->icon_pixbuf, width, height, GDK_INTERP_BILINEAR);
+  }
+
+  if (!slice->icon_data)
+    return gdk_pixbuf_new_from_file_at_scale (slice->icon, width, height, FALSE, error);
+
+  // Read straight out of the caller's buffer
+  stream = g_memory_input_stream_new_from_bytes (slice->icon_data);
+  pixbuf = gdk_pixbuf_new_from_stream_at_scale (stream, width, height, FALSE, NULL, error);
+  g_object_unref (stream);
+  return pixbuf;
+}
+
+/* Buffer the icon of a slice, SVGs at their natural size and other images
+ * decoded straight to the size they are drawn at */
+static void
+slice_rasterize (FittsmenuCore *core, cairo_t *cr, fittsmenu_slice *slice,
+                 FittsmenuSliceGeometry *geom)
+{
+  G_LOCK (slice_state);
+  // An icon replaced since geom was laid out is rasterized once it is loaded
+  if (geom->icon_serial == slice->icon_serial)
+    slice_rasterize_unlocked(core, cr, slice, geom);
+  G_UNLOCK (slice_state);
+}
+
+static void
+slice_rasterize_unlocked (FittsmenuCore *core, cairo_t *cr, fittsmenu_slice *slice,
+                          FittsmenuSliceGeometry *geom)
+{
+  cairo_surface_t *cr_surface, *mask;
+  cairo_t *cr_buf;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+  gint width, height;
+
+  // The caller's surface is painted as it is, only a mask or an upload
+  // made from it is ours and charged to the budget
+  if (slice->icon_surface) {
+    mask = raster_to_mask(slice, slice->icon_surface);
+    if (mask)
+      raster_keep(core, cr, slice, mask, geom->icon_width, geom->icon_height,
+                  cairo_image_surface_get_stride (mask) * geom->icon_height);
+    else
+      raster_keep(core, cr, slice, cairo_surface_reference (slice->icon_surface),
+                  geom->icon_width, geom->icon_height,
+                  core->remote ? geom->icon_width * geom->icon_height * 4 : 0);
+    return;
+  }
+
+  if (geom->icon_svg) {
+    /* All of this code looks severely outdated, mostly because cairo has good svg support now :)*/
+    // Only as large as the icon, this is what the budget is charged. Drawn
+    // in memory first to see whether it is a single colour.
+    cr_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                             geom->icon_width,
+                                             geom->icon_height);
+    cr_buf = cairo_create(cr_surface);
+    rsvg_handle_render_cairo (slice->icon_handle, cr_buf);
+    cairo_destroy(cr_buf);
+
+    mask = raster_to_mask(slice, cr_surface);
+    if (mask) {
+      cairo_surface_destroy(cr_surface);
+      raster_keep(core, cr, slice, mask, geom->icon_width, geom->icon_height,
+                  cairo_image_surface_get_stride (mask) * geom->icon_height);
+      return;
+    }
+
+    // Colour icons live next to the target as before
+    cr_surface = raster_upload(cr, cr_surface, geom->icon_width, geom->icon_height);
+    raster_account(core, slice, cr_surface, geom->icon_width, geom->icon_height,
+                   geom->icon_width * geom->icon_height * 4);
+  } else {
+    // PNG, JPEG, ICO or anything else gdk-pixbuf has a loader for, large
+    // JPEGs are scaled while decoding rather than after
+    raster_size(geom, &width, &height);
+    pixbuf = slice_decode(slice, width, height, &error);
+    if (!pixbuf) {
+      if (error)
+        g_printerr("GdkPixbuf: %s\n", error->message);
+      g_clear_error(&error);
+      return;
+    }
+
+    cr_surface = pixbuf_to_surface(pixbuf);
+    g_object_unref(pixbuf);
+    mask = raster_to_mask(slice, cr_surface);
+    if (mask) {
+      cairo_surface_destroy(cr_surface);
+      cr_surface = mask;
+    }
+    raster_keep(core, cr, slice, cr_surface,
+                cairo_image_surface_get_width (cr_surface),
+                cairo_image_surface_get_height (cr_surface),
+                cairo_image_surface_get_stride (cr_surface)
+                * cairo_image_surface_get_height (cr_surface));
+  }
+}
+
+/* Copy a raster into a surface similar to the target of cr, taking over
+ * the reference to surface. For xlib targets that is a Picture on the X
+ * server, so the pixels cross the wire once rather than with every frame
+ * they are painted in. Image targets get surface back as it is. */
+static cairo_surface_t*
+raster_upload (cairo_t *cr, cairo_surface_t *surface, gint width, gint height)
+{
+  cairo_surface_t *similar;
+  cairo_t *cr_buf;
+
+  if (cairo_surface_get_type (cairo_get_target (cr)) == CAIRO_SURFACE_TYPE_IMAGE)
+    return surface;
+
+  similar = cairo_surface_create_similar (cairo_get_target (cr),
+                                          cairo_surface_get_content (surface),
+                                          width, height);
+  cr_buf = cairo_create(similar);
+  cairo_set_source_surface(cr_buf, surface, 0.0, 0.0);
+  cairo_set_operator(cr_buf, CAIRO_OPERATOR_SOURCE);
+  cairo_paint(cr_buf);
+  cairo_destroy(cr_buf);
+  cairo_surface_destroy(surface);
+  return similar;
+}
+
+/* Hand a finished raster to the budget, remote menus upload every raster
+ * and not only colour ones */
+static void
+raster_keep (FittsmenuCore *core, cairo_t *cr, fittsmenu_slice *slice,
+             cairo_surface_t *surface, gint width, gint height, gsize bytes)
+{
+  if (core->remote)
+    surface = raster_upload(cr, surface, width, height);
+  raster_account(core, slice, surface, width, height, bytes);
+}
+
+/* Pixel size a non SVG icon is decoded at */
+static void
+raster_size (FittsmenuSliceGeometry *geom, gint *width, gint *height)
+{
+  *width = MAX(ceil(geom->icon_width * geom->icon_scale), 1);
+  *height = MAX(ceil(geom->icon_height * geom->icon_scale), 1);
+}
+
+/* Convert to cairo's premultiplied native endian ARGB, once per raster */
+static cairo_surface_t*
+pixbuf_to_surface (GdkPixbuf *pixbuf)
+{
+  cairo_surface_t *surface;
+  guchar *src_row, *src, *dst_row;
+  guint32 *dst;
+  gint width, height, n_channels, src_stride, dst_stride, x, y;
+  guint a, r, g, b, t;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  src_stride = gdk_pixbuf_get_rowstride (pixbuf);
+  src_row = gdk_pixbuf_get_pixels (pixbuf);
+
+  surface = cairo_image_surface_create (n_channels == 4 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
+                                        width, height);
+  dst_stride = cairo_image_surface_get_stride (surface);
+  dst_row = cairo_image_surface_get_data (surface);
+
+  for (y = 0; y < height; y++) {
+    src = src_row;
+    dst = (guint32 *)dst_row;
+    for (x = 0; x < width; x++) {
+      r = src[0];
+      g = src[1];
+      b = src[2];
+      a = n_channels == 4 ? src[3] : 0xff;
+      if (a != 0xff) {
+        // Divide by 255 with rounding
+        t = r * a + 0x80; r = ((t >> 8) + t) >> 8;
+        t = g * a + 0x80; g = ((t >> 8) + t) >> 8;
+        t = b * a + 0x80; b = ((t >> 8) + t) >> 8;
+      }
+      dst[x] = (a << 24) | (r << 16) | (g << 8) | b;
+      src += n_channels;
+    }
+    src_row += src_stride;
+    dst_row += dst_stride;
+  }
+
+  cairo_surface_mark_dirty (surface);
+  return surface;
+}
+
+/* An A8 copy of a single colour raster, a quarter of the size and drawn in
+ * whatever colour the slice's state calls for. The colour is kept on the
+ * slice. NULL if the raster has more than one colour and the slice isn't
+ * flagged monochrome, or has no alpha. */
+static cairo_surface_t*
+raster_to_mask (fittsmenu_slice *slice, cairo_surface_t *surface)
+{
+  cairo_surface_t *mask;
+  guchar *row, *mask_row;
+  guint32 *src, p;
+  gint width, height, stride, mask_stride, x, y;
+  gint a, r, g, b, r0 = 0, g0 = 0, b0 = 0;
+  gboolean first = TRUE;
+
+  if (cairo_image_surface_get_format (surface) != CAIRO_FORMAT_ARGB32)
+    return NULL;
+
+  cairo_surface_flush (surface);
+  width = cairo_image_surface_get_width (surface);
+  height = cairo_image_surface_get_height (surface);
+  stride = cairo_image_surface_get_stride (surface);
+  row = cairo_image_surface_get_data (surface);
+
+  for (y = 0; y < height; y++, row += stride) {
+    src = (guint32 *)row;
+    for (x = 0; x < width; x++) {
+      p = src[x];
+      a = p >> 24;
+      // Faint edge pixels don't keep enough precision to compare
+      if (a <= 16)
+        continue;
+      r = ((p >> 16) & 0xff) * 255 / a;
+      g = ((p >> 8) & 0xff) * 255 / a;
+      b = (p & 0xff) * 255 / a;
+      if (first) {
+        r0 = r; g0 = g; b0 = b;
+        first = FALSE;
+      } else if (!slice->monochrome
+                 && (ABS(r - r0) > 8 || ABS(g - g0) > 8 || ABS(b - b0) > 8)) {
+        return NULL;
+      }
+    }
+  }
+  if (first)
+    return NULL;
+
+  mask = cairo_image_surface_create (CAIRO_FORMAT_A8, width, height);
+  mask_stride = cairo_image_surface_get_stride (mask);
+  mask_row = cairo_image_surface_get_data (mask);
+  row = cairo_image_surface_get_data (surface);
+  for (y = 0; y < height; y++, row += stride, mask_row += mask_stride) {
+    src = (guint32 *)row;
+    for (x = 0; x < width; x++)
+      mask_row[x] = src[x] >> 24;
+  }
+  cairo_surface_mark_dirty (mask);
+
+  slice->glyph_red = r0 / 255.0;
+  slice->glyph_green = g0 / 255.0;
+  slice->glyph_blue = b0 / 255.0;
+  return mask;
+}
+
+/* Compute everything about the layout that doesn't change from frame to
+ * frame, the slice outlines, their angular bounds and icon placement. All of
+ * it is relative to the menu centre with the menu at angle 0. */
+static gboolean
+geometry_update (FittsmenuCore *core)
+{
+  FittsmenuSliceGeometry *geom;
+  FittsmenuRingGeometry *ring;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  fittsmenu_slice *slice;
+  GList *list;
+  gdouble arc_start, arc_end, arc_radius, arc_scale, icon_size;
+  gdouble outer_edge, inner_edge;
+  gint lod;
+  guint i, r, no_of_slices;
+
+  geometry_invalidate(core);
+
+  no_of_slices = g_list_length(core->slices);
+  if (no_of_slices < 1)
+    return FALSE;
+
+  core->geometry = g_new0(FittsmenuSliceGeometry, no_of_slices);
+  core->geometry_slices = no_of_slices;
+  geometry_update_rings(core);
+
+  // Paths are only recorded here, any surface will do
+  surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+  cr = cairo_create(surface);
+
+  list = core->slices;
+  for (r = 0; r < core->ring_count; r++) {
+    ring = &core->ring_geometry[r];
+
+    // Calculate the arc of a slice in radians
+    arc_radius = (2*G_PI) / ring->n_slices;
+    arc_scale = arc_radius / ((2*G_PI) / 13);
+
+    // Icons are 32 pixels across at 13 slices and shrink with the arc, and
+    // with the ring's circumference and width when there are several
+    icon_size = 32 * arc_scale * (ring->outer_radius / core->menu_radius);
+    if (core->n_rings > 1)
+      icon_size = MIN(icon_size, ring->outer_radius - ring->inner_radius - 8);
+    lod = core_lod(core, icon_size);
+
+    outer_edge = ring->outer_edge;
+    inner_edge = ring->inner_edge;
+
+    for (i = 0; i < ring->n_slices; i++, list = list->next) {
+      slice = (fittsmenu_slice *)list->data;
+      geom = &core->geometry[ring->first + i];
+
+      arc_start = i * arc_radius;
+      arc_end = arc_start + arc_radius;
+      geom->angle_start = arc_start;
+      geom->angle_end = arc_end;
+      geom->ring = r;
+
+      // Calculate the slice outline
+      cairo_new_path(cr);
+      cairo_arc(cr, 0, 0, outer_edge, arc_start, arc_end);
+      cairo_line_to(cr, ring->inner_radius * cos(arc_end),
+                        ring->inner_radius * sin(arc_end));
+      cairo_arc_negative(cr, 0, 0, inner_edge, arc_end, arc_start);
+      cairo_line_to(cr, outer_edge * cos(arc_start),
+                        outer_edge * sin(arc_start));
+      geom->path = cairo_copy_path(cr);
+      geometry_bound(geom, inner_edge, outer_edge);
+
+      geom->lod = lod;
+      geom->marker_size = icon_size;
+      geom->icon_angle = arc_start + (arc_radius / 2);
+      geom->icon_radius = ring->outer_radius;
+
+      // Too small to make out, only a marker is drawn until it is shown in
+      // detail
+      if (lod != FITTSMENU_LOD_ICON) {
+        polrec(ring->outer_radius - icon_size * G_SQRT2 / 2 - 4, geom->icon_angle,
+               &geom->icon_x, &geom->icon_y);
+        geom->icon_pending = TRUE;
+        continue;
+      }
+
+      if (!slice_load_icon(core, slice, geom))
+        continue;
+      geometry_place_icon(core, slice, geom, icon_size);
+    }
+  }
+
+  cairo_destroy(cr);
+  cairo_surface_destroy(surface);
+
+  core->geometry_valid = TRUE;
+  return TRUE;
+}
+
+/* Share the slices out between the rings and work out their radii, then
+ * fill the table hit testing picks a ring from. Returns the number of rings
+ * with slices in them. */
+static guint
+geometry_layout_rings (FittsmenuCore *core, guint no_of_slices)
+{
+  FittsmenuRingGeometry *ring;
+  const FittsmenuRing *spec;
+  gdouble band;
+  guint i, r, n_rings, first, count, inner;
+
+  n_rings = MAX(core->n_rings, 1);
+  band = (core->menu_radius - core->menu_inner_radius) / n_rings;
+  core->ring_geometry = g_new0(FittsmenuRingGeometry, n_rings);
+
+  first = 0;
+  for (i = 0, r = 0; i < n_rings && first < no_of_slices; i++) {
+    spec = core->rings ? &core->rings[i] : NULL;
+
+    // The last ring, and any without a count, take what is left
+    count = no_of_slices - first;
+    if (spec && spec->n_slices && i < n_rings - 1)
+      count = MIN(spec->n_slices, count);
+
+    ring = &core->ring_geometry[r++];
+    ring->first = first;
+    ring->n_slices = count;
+    if (spec && spec->outer_radius > 0) {
+      ring->inner_radius = spec->inner_radius;
+      ring->outer_radius = MIN(spec->outer_radius, core->menu_radius);
+    } else {
+      ring->inner_radius = core->menu_inner_radius + band * i;
+      ring->outer_radius = ring->inner_radius + band;
+    }
+    ring->outer_edge = ring->outer_radius - 3;
+    ring->inner_edge = i == 0 ? ring->inner_radius - 10 : ring->inner_radius;
+    first += count;
+  }
+  core->ring_count = r;
+
+  // Each distance belongs to the outermost ring starting inside it, so gaps
+  // between rings go to the ring below, and distances inside every ring to
+  // the innermost. Rings sharing the band between the menu's radii may sit
+  // among ones with radii of their own, so no order is assumed.
+  core->ring_at_size = MAX(core->menu_radius, 0) + 1;
+  core->ring_at = g_new0(guint8, core->ring_at_size);
+  inner = 0;
+  for (r = 1; r < core->ring_count; r++)
+    if (core->ring_geometry[r].inner_radius < core->ring_geometry[inner].inner_radius)
+      inner = r;
+  for (i = 0; i < core->ring_at_size; i++) {
+    core->ring_at[i] = inner;
+    for (r = 0; r < core->ring_count; r++)
+      if (i >= core->ring_geometry[r].inner_radius
+          && core->ring_geometry[r].inner_radius
+             > core->ring_geometry[core->ring_at[i]].inner_radius)
+        core->ring_at[i] = r;
+  }
+
+  return core->ring_count;
+}
+
+/* Lay out the rings alone, enough for hit testing without loading any
+ * icons. Returns FALSE if there are no slices. */
+static gboolean
+geometry_update_rings (FittsmenuCore *core)
+{
+  guint no_of_slices;
+
+  if (core->ring_geometry)
+    return TRUE;
+
+  no_of_slices = g_list_length(core->slices);
+  if (no_of_slices < 1)
+    return FALSE;
+  geometry_layout_rings(core, no_of_slices);
+  return TRUE;
+}
+
+/* The ring slice index lies in, NULL past the last slice */
+static FittsmenuRingGeometry*
+geometry_ring_of (FittsmenuCore *core, guint index)
+{
+  guint r;
+
+  for (r = 0; r < core->ring_count; r++)
+    if (index < core->ring_geometry[r].first + core->ring_geometry[r].n_slices)
+      return &core->ring_geometry[r];
+  return NULL;
+}
+
+/* Smallest circle through the corners of a slice's outline, which holds the
+ * whole slice while it spans no more than half the ring. Wider ones are
+ * bounded by the ring itself. */
+static void
+geometry_bound (FittsmenuSliceGeometry *geom, gdouble inner_edge, gdouble outer_edge)
+{
+  gdouble half, middle, outer, inner;
+
+  half = (geom->angle_end - geom->angle_start) / 2;
+  if (half > G_PI / 2) {
+    geom->bound_x = 0;
+    geom->bound_y = 0;
+    geom->bound_radius = outer_edge + FITTSMENU_BOUND_MARGIN;
+    return;
+  }
+
+  middle = (inner_edge + outer_edge) / 2;
+  polrec(middle, geom->angle_start + half, &geom->bound_x, &geom->bound_y);
+
+  // The corners are the points furthest from the middle of the slice
+  outer = outer_edge * outer_edge + middle * middle - 2 * outer_edge * middle * cos(half);
+  inner = inner_edge * inner_edge + middle * middle - 2 * inner_edge * middle * cos(half);
+  geom->bound_radius = sqrt(MAX(outer, inner)) + FITTSMENU_BOUND_MARGIN;
+}
+
+/* Scale and position a loaded icon so its longer side is size pixels */
+static void
+geometry_place_icon (FittsmenuCore *core, fittsmenu_slice *slice,
+                     FittsmenuSliceGeometry *geom, gdouble size)
+{
+  gdouble icon_cdist, icon_scale;
+  gint icon_width, icon_height;
+
+  // Calculate the size/position of the current icon
+  if (geom->icon_width >= geom->icon_height)
+  	icon_scale = size / (gdouble)geom->icon_width;
+  else
+  	icon_scale = size / (gdouble)geom->icon_height;
+
+  icon_width  = geom->icon_width * icon_scale;
+  icon_height = geom->icon_height * icon_scale;
+
+  geom->icon_scale = icon_scale;
+  geom->icon_offset_x = icon_width / 2;
+  geom->icon_offset_y = icon_height / 2;
+
+  icon_cdist = geom->icon_radius - (sqrt(icon_width*icon_width + icon_height*icon_height)/2) - 4;
+  polrec(icon_cdist, geom->icon_angle, &geom->icon_x, &geom->icon_y);
+
+  // Decoded rasters are only good for the size they were decoded at
+  if (!geom->icon_svg && !slice->icon_surface && slice->icon_buffer) {
+    raster_size(geom, &icon_width, &icon_height);
+    if (slice->buffer_width != icon_width || slice->buffer_height != icon_height)
+      raster_release(slice);
+  }
+}
+
+/* Level of detail for icons drawn size pixels across */
+static gint
+core_lod (FittsmenuCore *core, gdouble size)
+{
+  if (size >= core->lod_icon_min)
+    return FITTSMENU_LOD_ICON;
+  if (size >= core->lod_glyph_min)
+    return FITTSMENU_LOD_GLYPH;
+  if (size >= core->lod_swatch_min)
+    return FITTSMENU_LOD_SWATCH;
+  return FITTSMENU_LOD_DOT;
+}
+
+/* Forget the cached layout, it is recomputed on the next frame */
+static void
+geometry_invalidate (FittsmenuCore *core)
+{
+  guint i;
+
+  for (i = 0; i < core->geometry_slices; i++)
+    cairo_path_destroy(core->geometry[i].path);
+  g_free(core->geometry);
+
+  core->geometry = NULL;
+  core->geometry_slices = 0;
+  core->geometry_valid = FALSE;
+
+  g_free(core->ring_geometry);
+  g_free(core->ring_at);
+  core->ring_geometry = NULL;
+  core->ring_count = 0;
+  core->ring_at = NULL;
+  core->ring_at_size = 0;
+  sprites_clear(core);
+}
+
+/* Slices */
+fittsmenu_slice*
+fittsmenu_slice_new (const char* label, const char* icon) {
+	fittsmenu_slice *slice;
+	slice = g_slice_new0(fittsmenu_slice);
+	slice->icon = g_strdup(icon);
+	slice->label = g_strdup(label);
+  slice->progress = -1;
+  slice->ref_count = 1;
+  return slice;
+}
+
+/* Slices with icons held in memory, referenced rather than copied. The icon
+ * is never looked for on disk, not even the missing icon. */
+fittsmenu_slice*
+fittsmenu_slice_new_from_bytes (const char* label, GBytes *data)
+{
+  fittsmenu_slice *slice;
+
+  slice = fittsmenu_slice_new(label, NULL);
+  slice->icon_data = g_bytes_ref(data);
+  return slice;
+}
+
+fittsmenu_slice*
+fittsmenu_slice_new_from_pixbuf (const char* label, GdkPixbuf *pixbuf)
+{
+  fittsmenu_slice *slice;
+
+  slice = fittsmenu_slice_new(label, NULL);
+  slice->icon_pixbuf = g_object_ref(pixbuf);
+  return slice;
+}
+
+fittsmenu_slice*
+fittsmenu_slice_new_from_surface (const char* label, cairo_surface_t *surface)
+{
+  fittsmenu_slice *slice;
+
+  g_return_val_if_fail(cairo_surface_get_type (surface) == CAIRO_SURFACE_TYPE_IMAGE, NULL);
+
+  slice = fittsmenu_slice_new(label, NULL);
+  slice->icon_surface = cairo_surface_reference(surface);
+  return slice;
+}
+
+/* Resources compiled into the program are used where they lie, the path
+ * only names the icon. NULL if there is no such resource. */
+fittsmenu_slice*
+fittsmenu_slice_new_from_resource (const char* label, const char* path)
+{
+  fittsmenu_slice *slice;
+  GError *error = NULL;
+  GBytes *data;
+
+  data = g_resources_lookup_data(path, G_RESOURCE_LOOKUP_FLAGS_NONE, &error);
+  if (!data) {
+    g_printerr("GResource: %s\n", error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+
+  slice = fittsmenu_slice_new(label, path);
+  slice->icon_data = data;
+  return slice;
+}
+
+/* A slice in storage that outlives every menu, such as a static table. The
+ * storage holds the first reference so the slice is never freed, and the
+ * label and icon are only borrowed. */
+void
+fittsmenu_slice_init_static (fittsmenu_slice *slice, const char* label, const char* icon)
+{
+  memset(slice, 0, sizeof(fittsmenu_slice));
+  slice->label = (gchar *)label;
+  slice->icon = (gchar *)icon;
+  slice->static_names = TRUE;
+  slice->icon_static = TRUE;
+  slice->progress = -1;
+  slice->ref_count = 1;
+}
+
+/* Store the icon as a mask in its tint even if it has more than one colour,
+ * single colour icons are found without this. Set before the slice is added. */
+void
+fittsmenu_slice_set_monochrome (fittsmenu_slice *slice, gboolean value)
+{
+  slice->monochrome = value;
+}
+
+/* Draw the slice in the disabled style and don't let it be picked. Set
+ * before the slice is added. */
+void
+fittsmenu_slice_set_sensitive (fittsmenu_slice *slice, gboolean value)
+{
+  slice->insensitive = !value;
+}
+
+/* Live updates */
+void
+fittsmenu_slice_set_badge (fittsmenu_slice *slice, const char* badge)
+{
+  G_LOCK (slice_state);
+  if (!g_strcmp0(slice->badge, badge)) {
+    G_UNLOCK (slice_state);
+    return;
+  }
+  g_free(slice->badge);
+  slice->badge = g_strdup(badge);
+  G_UNLOCK (slice_state);
+
+  slice_damage(slice, FALSE);
+}
+
+void
+fittsmenu_slice_set_progress (fittsmenu_slice *slice, gdouble fraction)
+{
+  fraction = fraction < 0 ? -1 : MIN(fraction, 1);
+
+  G_LOCK (slice_state);
+  if (slice->progress == fraction) {
+    G_UNLOCK (slice_state);
+    return;
+  }
+  slice->progress = fraction;
+  G_UNLOCK (slice_state);
+
+  slice_damage(slice, FALSE);
+}
+
+/* Swap the icon for the file at icon, replacing an icon held in memory.
+ * Menus load and rasterize it on their next paint of the slice. */
+void
+fittsmenu_slice_set_icon (fittsmenu_slice *slice, const char* icon)
+{
+  G_LOCK (slice_state);
+  if (!slice->icon_static)
+    g_free(slice->icon);
+  slice->icon = g_strdup(icon);
+  slice->icon_static = FALSE;
+
+  if (slice->icon_handle)
+    rsvg_handle_free(slice->icon_handle);
+  slice->icon_handle = NULL;
+  if (slice->icon_data)
+    g_bytes_unref(slice->icon_data);
+  slice->icon_data = NULL;
+  if (slice->icon_pixbuf)
+    g_object_unref(slice->icon_pixbuf);
+  slice->icon_pixbuf = NULL;
+  if (slice->icon_surface)
+    cairo_surface_destroy(slice->icon_surface);
+  slice->icon_surface = NULL;
+
+  g_atomic_int_inc(&slice->icon_serial);
+  raster_release(slice);
+  G_UNLOCK (slice_state);
+
+  slice_damage(slice, TRUE);
+}
+
+gchar*
+fittsmenu_slice_dup_icon (fittsmenu_slice *slice)
+{
+  gchar *icon;
+
+  G_LOCK (slice_state);
+  icon = g_strdup(slice->icon);
+  G_UNLOCK (slice_state);
+  return icon;
+}
+
+fittsmenu_slice*
+fittsmenu_slice_ref (fittsmenu_slice *slice) {
+  g_atomic_int_inc(&slice->ref_count);
+  return slice;
+}
+
+void
+fittsmenu_slice_unref (fittsmenu_slice *slice) {
+  if (g_atomic_int_dec_and_test(&slice->ref_count))
+    slice_destroy(slice);
+}
+
+/* Kept for older callers, slices are reference counted now */
+void
+fittsmenu_slice_free (fittsmenu_slice *slice) {
+  fittsmenu_slice_unref(slice);
+}
+
+static void
+slice_destroy (fittsmenu_slice *slice) {
+  if (!slice->icon_static)
+    g_free(slice->icon);
+  if (!slice->static_names)
+    g_free(slice->label);
+  g_free(slice->badge);
+  raster_release(slice);
+  if (slice->icon_handle)
+    rsvg_handle_free(slice->icon_handle);
+  if (slice->icon_data)
+    g_bytes_unref(slice->icon_data);
+  if (slice->icon_pixbuf)
+    g_object_unref(slice->icon_pixbuf);
+  if (slice->icon_surface)
+    cairo_surface_destroy(slice->icon_surface);
+  if (!slice->static_names)
+    g_slice_free(fittsmenu_slice, slice);
+}
+
+/* Raster budget */
+void
+fittsmenu_set_raster_budget (gsize bytes)
+{
+  raster_budget = bytes;
+  raster_enforce_budget(NULL);
+}
+
+gsize
+fittsmenu_get_raster_budget (void)
+{
+  return raster_budget;
+}
+
+gsize
+fittsmenu_core_get_raster_bytes (FittsmenuCore *core)
+{
+  gsize bytes;
+
+  G_LOCK (raster_lru);
+  bytes = core->model ? core->model->raster_bytes : core->raster_bytes;
+  G_UNLOCK (raster_lru);
+  return bytes;
+}
+
+gsize
+fittsmenu_get_total_raster_bytes (void)
+{
+  gsize bytes;
+
+  G_LOCK (raster_lru);
+  bytes = raster_bytes;
+  G_UNLOCK (raster_lru);
+  return bytes;
+}
+
+/* Raster accounting, give a freshly buffered icon to its slice and charge
+ * it to the menu that drew it and to the library wide total. The slices of
+ * a model are shared by its views, their rasters are charged to the model
+ * rather than to whichever view drew them first. */
+static void
+raster_account (FittsmenuCore *core, fittsmenu_slice *slice,
+                cairo_surface_t *surface, gint width, gint height, gsize bytes)
+{
+  G_LOCK (raster_lru);
+  // Another menu sharing the slice got there first
+  if (slice->icon_buffer) {
+    G_UNLOCK (raster_lru);
+    cairo_surface_destroy(surface);
+    return;
+  }
+
+  if (!raster_lru)
+    raster_lru = g_queue_new();
+
+  slice->icon_buffer = surface;
+  slice->buffer_width = width;
+  slice->buffer_height = height;
+  slice->icon_bytes = bytes;
+  slice->core = core->model ? NULL : core;
+  slice->model = core->model;
+  g_queue_push_head(raster_lru, slice);
+  slice->raster_link = g_queue_peek_head_link(raster_lru);
+
+  raster_bytes += bytes;
+  if (slice->model)
+    slice->model->raster_bytes += bytes;
+  else
+    core->raster_bytes += bytes;
+  G_UNLOCK (raster_lru);
+}
+
+/* A new reference to the raster of a slice, marked as most recently
+ * painted, or NULL if there is none */
+static cairo_surface_t*
+raster_get (fittsmenu_slice *slice, gint *width, gint *height)
+{
+  cairo_surface_t *surface = NULL;
+
+  G_LOCK (raster_lru);
+  if (slice->icon_buffer) {
+    surface = cairo_surface_reference(slice->icon_buffer);
+    *width = slice->buffer_width;
+    *height = slice->buffer_height;
+  }
+  if (slice->raster_link) {
+    g_queue_unlink(raster_lru, slice->raster_link);
+    g_queue_push_head_link(raster_lru, slice->raster_link);
+  }
+  G_UNLOCK (raster_lru);
+  return surface;
+}
+
+/* Drop the raster of a slice, it will be rasterized again on its next paint */
+static void
+raster_release (fittsmenu_slice *slice)
+{
+  G_LOCK (raster_lru);
+  raster_release_unlocked(slice);
+  G_UNLOCK (raster_lru);
+}
+
+static void
+raster_release_unlocked (fittsmenu_slice *slice)
+{
+  if (slice->icon_buffer)
+    cairo_surface_destroy(slice->icon_buffer);
+  slice->icon_buffer = NULL;
+
+  if (!slice->raster_link)
+    return;
+
+  g_queue_delete_link(raster_lru, slice->raster_link);
+  slice->raster_link = NULL;
+
+  raster_bytes -= slice->icon_bytes;
+  if (slice->core)
+    slice->core->raster_bytes -= slice->icon_bytes;
+  if (slice->model)
+    slice->model->raster_bytes -= slice->icon_bytes;
+  slice->icon_bytes = 0;
+  slice->core = NULL;
+  slice->model = NULL;
+}
+
+/* Drop the rasters charged to core or model of the slices in old that are
+ * not in snapshot, which may be NULL for all of them */
+static void
+raster_release_left (FittsmenuSnapshot *old, FittsmenuSnapshot *snapshot,
+                     FittsmenuCore *core, FittsmenuModel *model)
+{
+  fittsmenu_slice *slice;
+  GHashTable *kept;
+  guint i;
+
+  kept = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for (i = 0; snapshot && i < snapshot->n_slices; i++)
+    g_hash_table_add(kept, snapshot->slices[i]);
+
+  G_LOCK (raster_lru);
+  for (i = 0; i < old->n_slices; i++) {
+    slice = old->slices[i];
+    if (((core && slice->core == core) || (model && slice->model == model))
+        && !g_hash_table_contains(kept, slice))
+      raster_release_unlocked(slice);
+  }
+  G_UNLOCK (raster_lru);
+  g_hash_table_destroy(kept);
+}
+
+/* Evict least recently painted rasters until we are within the budget, keep
+ * is the raster currently being painted and is never evicted */
+static void
+raster_enforce_budget (fittsmenu_slice *keep)
+{
+  fittsmenu_slice *slice;
+
+  G_LOCK (raster_lru);
+  while (raster_budget && raster_lru && raster_bytes > raster_budget) {
+    slice = g_queue_peek_tail(raster_lru);
+    if (!slice || slice == keep)
+      break;
+    raster_release_unlocked(slice);
+  }
+  G_UNLOCK (raster_lru);
+}
+
+/* Cartesian co-ordinate conversion*/
+static
+void recpol(gdouble x, gdouble y, gdouble *pr, gdouble *pa)
+{
+  gdouble a;
+
+  if (x == 0.0 && y == 0.0) { /* special case, both components 0 */
+    *pa = 0.0;
+    *pr = 0.0;
+    return;
+  }
+
+  a = atan2(y,x);             /* angle +- pi/2 */
+  if (a < 0.0)
+    a = a + (2 * M_PI);       /* want it to be 0 to 2 pi   */
+  *pa = a;
+/**pr = hypot(x,y);*/         /* radius.  HP bug in hypot. */
+  *pr = sqrt(x*x + y*y);      /* radius */
+  return;
+}
+
+static
+void polrec(gdouble r, gdouble a, gdouble *px, gdouble *py)
+{
+  *px = r*cos(a);
+  *py = r*sin(a);
+  return;
+}
@@ -0,0 +1,365 @@
+#ifndef __FITTSMENU_CORE_H__
+#define __FITTSMENU_CORE_H__
+
+#include <glib.h>
+#include <cairo.h>
+#include <librsvg/rsvg.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+typedef struct _fittsmenu_slice fittsmenu_slice;
+typedef struct _FittsmenuCore   FittsmenuCore;
+typedef struct _FittsmenuSnapshot  FittsmenuSnapshot;
+typedef struct _FittsmenuModel  FittsmenuModel;
+
+typedef void (*FittsmenuCoreNotify) (FittsmenuCore *core, gpointer user_data);
+
+/* Produces item index of a data source, returning a new reference */
+typedef fittsmenu_slice* (*FittsmenuSliceFunc) (guint index, gpointer user_data);
+
+struct _fittsmenu_slice
+{
+  gchar *label;
+  gchar *icon;
+  gint button;
+  RsvgHandle *icon_handle;
+  cairo_surface_t *icon_buffer;
+  gint buffer_width;
+  gint buffer_height;
+  guint index;  // Unused, a shared slice has a position in each menu, see fittsmenu_core_get_index()
+  gint ref_count;
+  gboolean static_names;  // label and icon are borrowed, see fittsmenu_slice_init_static()
+  gboolean icon_static;   // icon is still the borrowed one
+
+  /* Icons held in memory, referenced rather than copied. With one of these
+   * set icon is only a name and nothing is read from disk. */
+  GBytes *icon_data;
+  GdkPixbuf *icon_pixbuf;
+  cairo_surface_t *icon_surface;
+
+  gboolean insensitive;
+
+  /* Live state, changed from any thread through the setters. Badges and
+   * progress are drawn over the ring, a progress below 0 is none. */
+  gchar *badge;
+  gdouble progress;
+  gint icon_serial;     // Bumped whenever the icon is replaced
+
+  /* Icons of a single colour are kept as an alpha mask in this colour */
+  gboolean monochrome;
+  gdouble glyph_red;
+  gdouble glyph_green;
+  gdouble glyph_blue;
+
+  /* Raster accounting, core is the menu that drew the raster, or model
+   * when that menu is a view of one */
+  FittsmenuCore *core;
+  FittsmenuModel *model;
+  gsize icon_bytes;
+  GList *raster_link;
+
+  /* Menus whose adopted snapshot holds the slice, not referenced, under the
+   * damage lock. Changes in place are handed to these only. */
+  GSList *cores;
+};
+
+enum
+{
+	FITTSMENU_ANIM_NONE,
+	FITTSMENU_ANIM_CROTATE,
+	FITTSMENU_ANIM_ISCALE,
+	FITTSMENU_ANIM_PULSE
+};
+
+/* Slice states, each with its own style and icon tint */
+enum
+{
+  FITTSMENU_STATE_NORMAL,
+  FITTSMENU_STATE_HOVER,
+  FITTSMENU_STATE_ACTIVE,
+  FITTSMENU_STATE_DISABLED,
+  FITTSMENU_STATE_LAST
+};
+
+/* How a slice is filled and outlined. The fill runs from fill_inner at the
+ * inner edge of the ring to fill_outer at the outer edge, equal colours
+ * make a flat fill. Colours are RGBA from 0 to 1. */
+typedef struct
+{
+  gdouble fill_inner[4];
+  gdouble fill_outer[4];
+  gdouble stroke[4];
+  gdouble stroke_width;
+} FittsmenuSliceStyle;
+
+/* How much of a slice's icon is drawn, see fittsmenu_core_set_lod_sizes() */
+enum
+{
+  FITTSMENU_LOD_ICON,
+  FITTSMENU_LOD_GLYPH,
+  FITTSMENU_LOD_SWATCH,
+  FITTSMENU_LOD_DOT
+};
+
+/* A ring of slices. Rings are listed from the centre out and take their
+ * slices in order, a count of 0 and the last ring take whatever is left.
+ * With an outer radius of 0 the rings split the band between the menu's
+ * inner and outer radius evenly. Rings with radii given out of order are
+ * sorted by inner radius. */
+typedef struct
+{
+  guint    n_slices;
+  gint     inner_radius;
+  gint     outer_radius;
+} FittsmenuRing;
+
+/* Pointer and layout state, for handing frames to a core on another thread */
+typedef struct
+{
+  gint     menu_radius;
+  gint     menu_inner_radius;
+  gint     menu_angle;
+  gdouble  mouse_angle;
+  gdouble  mouse_distance;
+  gboolean menu_over;
+  guint    first;     // Item index of the first slice, for a data source
+} FittsmenuCoreState;
+
+G_BEGIN_DECLS
+
+/* The toolkit independent part of a Fittsmenu: the ring layout, hit testing,
+ * animation state and drawing. It is driven by explicit pointer input and
+ * time, and draws into any cairo context, so it runs without a display. */
+FittsmenuCore*   fittsmenu_core_new      (void);
+void             fittsmenu_core_free     (FittsmenuCore *core);
+
+/* Getters and setters */
+void       fittsmenu_core_set_animation         (FittsmenuCore *core, gint value);
+gint       fittsmenu_core_get_animation         (FittsmenuCore *core);
+void       fittsmenu_core_set_menu_radius       (FittsmenuCore *core, gint value);
+gint       fittsmenu_core_get_menu_radius       (FittsmenuCore *core);
+void       fittsmenu_core_set_menu_inner_radius (FittsmenuCore *core, gint value);
+gint       fittsmenu_core_get_menu_inner_radius (FittsmenuCore *core);
+void       fittsmenu_core_set_overlay           (FittsmenuCore *core, gboolean value);
+void       fittsmenu_core_set_frame_interval    (FittsmenuCore *core, gint64 usec);
+void       fittsmenu_core_set_missing_icon      (FittsmenuCore *core, const gchar *path);
+
+/* Single colour icons are kept as A8 masks and painted in a tint for the
+ * slice's state, which costs nothing over painting them as they are. Hover
+ * and active fall back to the normal tint, and that to the icon's colour. */
+void       fittsmenu_core_set_icon_tint         (FittsmenuCore *core, gint tint,
+                                                 gdouble red, gdouble green,
+                                                 gdouble blue, gdouble alpha);
+void       fittsmenu_core_unset_icon_tint       (FittsmenuCore *core, gint tint);
+
+/* Style of the slices in a FITTSMENU_STATE_*, NULL restores the default.
+ * Fills are compiled into cairo patterns when first drawn and only rebuilt
+ * when a style or the radii change, gradients cost no more than flat
+ * colours per frame. */
+void       fittsmenu_core_set_slice_style       (FittsmenuCore *core, gint state,
+                                                 const FittsmenuSliceStyle *style);
+void       fittsmenu_core_get_slice_style       (FittsmenuCore *core, gint state,
+                                                 FittsmenuSliceStyle *style);
+
+/* Adaptive placement. With a usage id set, activations are counted in the
+ * user's config directory under that id, and the menu opens turned so the
+ * slice most likely to be picked lies towards the approach angle, in
+ * degrees clockwise from up. The turn is chosen once per session. Counts
+ * are kept in memory and written from the main loop a few seconds after the
+ * last activation, or when the id changes or the menu is freed. */
+void       fittsmenu_core_set_usage_id          (FittsmenuCore *core, const gchar *menu_id);
+const gchar* fittsmenu_core_get_usage_id        (FittsmenuCore *core);
+void       fittsmenu_core_set_approach_angle    (FittsmenuCore *core, gdouble degrees);
+
+/* Slices, appending takes over the caller's reference and removing drops it */
+void       fittsmenu_core_append      (FittsmenuCore *core, fittsmenu_slice *slice);
+void       fittsmenu_core_remove      (FittsmenuCore *core, fittsmenu_slice *slice);
+GList*     fittsmenu_core_get_slices  (FittsmenuCore *core);
+fittsmenu_slice*  fittsmenu_core_get_active (FittsmenuCore *core);
+fittsmenu_slice*  fittsmenu_core_get_hover  (FittsmenuCore *core);
+/* -1 for a slice the menu doesn't show */
+gint       fittsmenu_core_get_index   (FittsmenuCore *core, fittsmenu_slice *slice);
+void       fittsmenu_core_set_active  (FittsmenuCore *core, guint index, fittsmenu_slice *slice);
+
+/* Input and time. Pointer co-ordinates are relative to the top left of the
+ * menu, which is a square twice the menu radius across. Motion is recorded
+ * and applied by fittsmenu_core_advance(), which returns TRUE when the menu
+ * needs to be drawn again. Times are in microseconds. */
+void       fittsmenu_core_reset          (FittsmenuCore *core);
+void       fittsmenu_core_pointer_motion (FittsmenuCore *core, gdouble x, gdouble y);
+void       fittsmenu_core_pointer_enter  (FittsmenuCore *core);
+void       fittsmenu_core_pointer_leave  (FittsmenuCore *core);
+gboolean   fittsmenu_core_advance        (FittsmenuCore *core, gint64 time);
+fittsmenu_slice*  fittsmenu_core_activate (FittsmenuCore *core);
+/* The slice under the pointer as it is now, rather than in the last frame
+ * drawn, NULL when the pointer is outside the menu */
+fittsmenu_slice*  fittsmenu_core_pick   (FittsmenuCore *core);
+/* Select the slice lying in the direction of a stroke dx, dy from the
+ * centre, as the menu is laid out after fittsmenu_core_reset(). Rotation by
+ * CROTATE is ignored so each direction always marks the same slice, only
+ * the usage orientation turns the layout. The length of the stroke picks the
+ * ring as a pointer that far from the centre would, so with several rings a
+ * short stroke marks the inner one and a long stroke an outer one. */
+fittsmenu_slice*  fittsmenu_core_mark   (FittsmenuCore *core, gdouble dx, gdouble dy);
+
+/* Menu contents as an immutable, reference counted list of slices. Any
+ * thread may build a snapshot and publish it, the menu swaps it in at the
+ * start of its next frame or on fittsmenu_core_sync(). Publishing never
+ * blocks and only the newest unadopted snapshot is kept. */
+FittsmenuSnapshot*  fittsmenu_snapshot_new   (fittsmenu_slice **slices, guint n_slices);
+FittsmenuSnapshot*  fittsmenu_snapshot_ref   (FittsmenuSnapshot *snapshot);
+void                fittsmenu_snapshot_unref (FittsmenuSnapshot *snapshot);
+guint               fittsmenu_snapshot_get_n_slices (FittsmenuSnapshot *snapshot);
+fittsmenu_slice*    fittsmenu_snapshot_get_slice    (FittsmenuSnapshot *snapshot, guint index);
+
+void       fittsmenu_core_publish        (FittsmenuCore *core, FittsmenuSnapshot *snapshot);
+gboolean   fittsmenu_core_sync           (FittsmenuCore *core);
+FittsmenuSnapshot*  fittsmenu_core_get_snapshot (FittsmenuCore *core);
+void       fittsmenu_core_set_publish_notify (FittsmenuCore *core, FittsmenuCoreNotify func,
+                                              gpointer user_data);
+
+/* Slices this menu shows changed in place by fittsmenu_slice_set_badge()
+ * and friends. The notify is called on the changing thread, the menu's own
+ * thread then takes the damage, the area covering the changed sectors in
+ * menu co-ordinates. Returns FALSE if the changed slices have left the menu
+ * since. */
+void       fittsmenu_core_set_damage_notify (FittsmenuCore *core, FittsmenuCoreNotify func,
+                                             gpointer user_data);
+gboolean   fittsmenu_core_take_damage    (FittsmenuCore *core, gint *x, gint *y,
+                                          gint *width, gint *height);
+
+/* Contents shared between any number of menus. Each view keeps its own
+ * rotation, hover and layout, the slices with their icon handles and
+ * rasters exist once. Changing the model, from any thread, publishes the
+ * new contents to every view, and changing a view changes its model. A
+ * view holds a reference on its model. The views' publish notifies are
+ * called outside the model's lock and may read it, but must not publish to
+ * it or bind menus to it. */
+FittsmenuModel*     fittsmenu_model_new     (void);
+FittsmenuModel*     fittsmenu_model_ref     (FittsmenuModel *model);
+void                fittsmenu_model_unref   (FittsmenuModel *model);
+void                fittsmenu_model_append  (FittsmenuModel *model, fittsmenu_slice *slice);
+void                fittsmenu_model_remove  (FittsmenuModel *model, fittsmenu_slice *slice);
+void                fittsmenu_model_publish (FittsmenuModel *model, FittsmenuSnapshot *snapshot);
+FittsmenuSnapshot*  fittsmenu_model_get_snapshot (FittsmenuModel *model);
+
+void            fittsmenu_core_set_model (FittsmenuCore *core, FittsmenuModel *model);
+FittsmenuModel* fittsmenu_core_get_model (FittsmenuCore *core);
+
+/* Data source mode, the menu shows a window of n_visible items out of
+ * n_items and asks func for slices as they scroll into view. Only the window
+ * and the items either side of it are kept. A NULL func leaves the mode. */
+void       fittsmenu_core_set_source     (FittsmenuCore *core, guint n_items, guint n_visible,
+                                          FittsmenuSliceFunc func, gpointer user_data,
+                                          GDestroyNotify notify);
+void       fittsmenu_core_source_changed (FittsmenuCore *core, guint n_items);
+gboolean   fittsmenu_core_scroll         (FittsmenuCore *core, gint delta);
+guint      fittsmenu_core_get_first      (FittsmenuCore *core);
+gboolean   fittsmenu_core_is_animating   (FittsmenuCore *core);
+
+/* Copy the pointer and layout of one core into another, so a second core
+ * sharing the slices can draw the same frame on another thread */
+void       fittsmenu_core_get_state      (FittsmenuCore *core, FittsmenuCoreState *state);
+void       fittsmenu_core_set_state      (FittsmenuCore *core, const FittsmenuCoreState *state);
+
+/* Level of detail for crowded menus. Icons that would be drawn smaller than
+ * icon_min pixels are shown as the first letter of their label, below
+ * glyph_min as a colour swatch and below swatch_min as a dot, and aren't
+ * loaded at all. The hovered slice and its neighbours still get their icons,
+ * icon_min pixels across. Defaults are 16, 10 and 6, all 0 always draws
+ * icons. */
+void       fittsmenu_core_set_lod_sizes    (FittsmenuCore *core, gint icon_min,
+                                            gint glyph_min, gint swatch_min);
+
+/* Sprite cache, for machines with memory to spare and little CPU. The ring
+ * is drawn at n_angles evenly spaced angles, without hover, and rotations
+ * snap to the nearest of them so frames are a blit plus the hovered
+ * sector. Sprites are drawn on first use or by fittsmenu_core_prerender(),
+ * which draws one per call and returns TRUE while there are more. Beyond
+ * max_bytes, 0 for no limit, angles are drawn in full. 0 angles is off. */
+void       fittsmenu_core_set_sprite_cache (FittsmenuCore *core, guint n_angles, gsize max_bytes);
+gsize      fittsmenu_core_get_sprite_bytes (FittsmenuCore *core);
+gboolean   fittsmenu_core_prerender        (FittsmenuCore *core);
+
+/* Concentric rings, each with its own slice count and radii. The pointer's
+ * distance from the centre picks the ring and its angle the slice, in
+ * constant time however many rings and slices there are. Strokes marked
+ * with fittsmenu_core_mark() pick the ring by their length. NULL or 0 rings
+ * is a single ring. */
+void       fittsmenu_core_set_rings        (FittsmenuCore *core, const FittsmenuRing *rings,
+                                            guint n_rings);
+guint      fittsmenu_core_get_n_rings      (FittsmenuCore *core);
+/* Ring of the hovered slice, -1 when there is none */
+gint       fittsmenu_core_get_hover_ring   (FittsmenuCore *core);
+/* Where slice index is drawn now: the pointer angle of its middle, in
+ * degrees clockwise from up, and the distance halfway across its outline,
+ * with the outline's depth and the degrees it spans. Any may be NULL.
+ * Returns FALSE if there is no such slice. */
+gboolean   fittsmenu_core_get_slice_centre (FittsmenuCore *core, guint index, gdouble *angle,
+                                            gdouble *distance, gdouble *depth, gdouble *span);
+
+/* For displays across a network. Icon rasters and sprites are kept in
+ * surfaces similar to the render target, which for xlib targets are
+ * Pictures on the X server, so they are sent once and each frame only
+ * composites them. Sprites are then drawn on first use, not by
+ * fittsmenu_core_prerender(). */
+void       fittsmenu_core_set_remote       (FittsmenuCore *core, gboolean value);
+gboolean   fittsmenu_core_get_remote       (FittsmenuCore *core);
+
+/* Picture shown in the centre disc, such as a preview of what the hovered
+ * slice opens, NULL for none. It must be an image surface and is scaled
+ * to fit the disc. May be set while another thread draws the menu. */
+void       fittsmenu_core_set_preview      (FittsmenuCore *core, cairo_surface_t *surface);
+/* Size in pixels a preview is shown at without scaling */
+gint       fittsmenu_core_get_preview_size (FittsmenuCore *core);
+
+/* Draw the menu with its top left corner at the origin of cr */
+void       fittsmenu_core_render         (FittsmenuCore *core, cairo_t *cr);
+/* Append the ring the slices cover to the path of cr, as two circles to be
+ * filled or clipped with CAIRO_FILL_RULE_EVEN_ODD. The translucent centre is
+ * left out, for displays that can only show the menu as a shaped window,
+ * except for the rectangle the preview covers while one is set. */
+void       fittsmenu_core_ring_path      (FittsmenuCore *core, cairo_t *cr);
+
+/* Slices are reference counted and may be shared between snapshots. The
+ * label must not change once a slice is in a snapshot, the icon only
+ * through fittsmenu_slice_set_icon(). */
+fittsmenu_slice*  fittsmenu_slice_new (const char* label, const char* icon);
+/* Icons from memory, none of them touch the filesystem. Bytes are an SVG or
+ * any image gdk-pixbuf reads, surfaces must be image surfaces. */
+fittsmenu_slice*  fittsmenu_slice_new_from_bytes    (const char* label, GBytes *data);
+fittsmenu_slice*  fittsmenu_slice_new_from_pixbuf   (const char* label, GdkPixbuf *pixbuf);
+fittsmenu_slice*  fittsmenu_slice_new_from_surface  (const char* label, cairo_surface_t *surface);
+fittsmenu_slice*  fittsmenu_slice_new_from_resource (const char* label, const char* path);
+void              fittsmenu_slice_init_static (fittsmenu_slice *slice, const char* label,
+                                               const char* icon);
+fittsmenu_slice*  fittsmenu_slice_ref   (fittsmenu_slice *slice);
+void              fittsmenu_slice_unref (fittsmenu_slice *slice);
+void			 fittsmenu_slice_free (fittsmenu_slice *slice);
+void              fittsmenu_slice_set_monochrome (fittsmenu_slice *slice, gboolean value);
+void              fittsmenu_slice_set_sensitive  (fittsmenu_slice *slice, gboolean value);
+
+/* Update a slice in place, from any thread, while menus show it. Only its
+ * sector is drawn again. A badge is short text such as a count, NULL
+ * removes it, and progress runs from 0 to 1, below 0 removes it. Neither
+ * goes into icon rasters or sprites. A new icon is rasterized on its next
+ * paint and drops the sprites of the menus showing it. */
+void              fittsmenu_slice_set_badge      (fittsmenu_slice *slice, const char* badge);
+void              fittsmenu_slice_set_progress   (fittsmenu_slice *slice, gdouble fraction);
+void              fittsmenu_slice_set_icon       (fittsmenu_slice *slice, const char* icon);
+/* A copy of the icon path, which another thread may be replacing. Free it
+ * with g_free(). */
+gchar*            fittsmenu_slice_dup_icon       (fittsmenu_slice *slice);
+
+/* Icon raster memory, shared between every Fittsmenu. A budget of 0 means
+ * unlimited, otherwise the least recently painted rasters are dropped and
+ * rasterized again when next needed. */
+void       fittsmenu_set_raster_budget      (gsize bytes);
+gsize      fittsmenu_get_raster_budget      (void);
+/* Bytes held by a menu's rasters. The rasters of a model's slices are
+ * shared, every view of it reports all of them. */
+gsize      fittsmenu_core_get_raster_bytes  (FittsmenuCore *core);
+gsize      fittsmenu_get_total_raster_bytes (void);
+
+G_END_DECLS
+
+#endif /* __FITTSMENU_CORE_H__ */
@@ -39,9 +39,6 @@
 #include <gdk/gdkx.h>
 #include <gdk/gdkkeysyms.h>
 #include <gtk/gtk.h>
-#include <gtk/gtkwidget.h>
-#include <librsvg/rsvg.h>
-#include <librsvg/rsvg-cairo.h>
 #include <string.h>
 
 /**
@@ -55,26 +52,73 @@
 
 #include "fittsmenu.h"
 
+/* The ring itself lives in fittsmenu-core.c, this is the widget around it.
+ * It builds against GTK+ 2 or GTK+ 3, where GTK+ 3 paces pointer updates
+ * with the widget's GdkFrameClock instead of a fixed interval. */
+#define FITTSMENU_USE_GTK3 GTK_CHECK_VERSION (3, 0, 0)
+
 #define FITTSMENU_MIN_WIDTH 160
 
+/* Marks shorter than this are taken as a click and show the ring */
+#define FITTSMENU_MARK_MIN 20
+
+/* Finished previews kept for slices the pointer comes back to */
+#define FITTSMENU_PREVIEW_CACHE 8
+
 static void fittsmenu_class_intern_init(gpointer);
 static void fittsmenu_class_init (FittsmenuClass*);
 static void fittsmenu_init (GtkWidget *widget);
+static void fittsmenu_create_toplevel (Fittsmenu *fittsmenu);
+static void fittsmenu_queue_redraw (Fittsmenu *fittsmenu);
+static gboolean fittsmenu_pointer_moved (Fittsmenu *fittsmenu, gint mouse_x, gint mouse_y);
+static void fittsmenu_activate_hover (Fittsmenu *fittsmenu);
+static void fittsmenu_published (FittsmenuCore *core, gpointer data);
+static gboolean fittsmenu_publish_idle (gpointer data);
+static void fittsmenu_damaged (FittsmenuCore *core, gpointer data);
+static gboolean fittsmenu_damage_idle (gpointer data);
+static gboolean fittsmenu_animate (gpointer data);
+static void fittsmenu_stop_animation (Fittsmenu *fittsmenu);
+static void fittsmenu_request_frame (Fittsmenu *fittsmenu);
+static gpointer fittsmenu_render_thread (gpointer data);
+static gboolean fittsmenu_present (gpointer data);
+static void fittsmenu_paint_front (Fittsmenu *fittsmenu, cairo_t *cr);
+static void fittsmenu_stop_render_thread (Fittsmenu *fittsmenu);
+static void fittsmenu_forward_settings (Fittsmenu *fittsmenu, guint changed);
+static void fittsmenu_apply_theme (Fittsmenu *fittsmenu);
+#if FITTSMENU_USE_GTK3
+static void fittsmenu_style_updated (GtkWidget *widget);
+static void theme_colour (GtkStyleContext *context, const gchar *name, gdouble *rgb);
+#else
+static void fittsmenu_style_set (GtkWidget *widget, GtkStyle *previous_style);
+#endif
+static gboolean fittsmenu_prerender (gpointer data);
+static void fittsmenu_preview_hover (Fittsmenu *fittsmenu);
+static void fittsmenu_preview_cancel (Fittsmenu *fittsmenu);
+static void fittsmenu_preview_show (Fittsmenu *fittsmenu, cairo_surface_t *surface);
+static gboolean fittsmenu_preview_start (gpointer data);
+static void fittsmenu_preview_thread (GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable);
+static void fittsmenu_preview_done (GObject *source, GAsyncResult *result, gpointer data);
 static void fittsmenu_get_property (GObject*, guint, GValue*, GParamSpec*);
 static void fittsmenu_set_property (GObject*, guint, const GValue*, GParamSpec*);
          
 static void fittsmenu_realize (GtkWidget*);
+#if FITTSMENU_USE_GTK3
+static void fittsmenu_get_preferred_size (GtkWidget*, gint*, gint*);
+static gboolean fittsmenu_draw (GtkWidget*, cairo_t*);
+static gboolean fittsmenu_tick (GtkWidget*, GdkFrameClock*, gpointer);
+#else
 static void fittsmenu_size_request (GtkWidget*, GtkRequisition*);
+static gint fittsmenu_expose (GtkWidget*, GdkEventExpose*);
+static void fittsmenu_hide_all (GtkWidget *widget);
+#endif
 static void fittsmenu_size_allocate (GtkWidget*, GtkAllocation*);
 static void fittsmenu_show (GtkWidget *widget);
-static gint fittsmenu_expose (GtkWidget*, GdkEventExpose*);
-static gint fittsmenu_scroll (GtkWidget *widget, GdkEventExpose *event);
+static gint fittsmenu_scroll (GtkWidget *widget, GdkEventScroll *event);
 static gint fittsmenu_key_press (GtkWidget *widget, GdkEventKey *event);
 static gint fittsmenu_button_press (GtkWidget *widget, GdkEventButton *event);
 static gint fittsmenu_button_release (GtkWidget *widget, GdkEventButton *event);
 static gint fittsmenu_motion_notify (GtkWidget *widget, GdkEventMotion *event);
 static void fittsmenu_show_all (GtkWidget *widget);
-static void fittsmenu_hide_all (GtkWidget *widget);
 static void fittsmenu_dispose (GObject *obj);
 static void fittsmenu_finalize (GObject *obj);
 static gboolean fittsmenu_enter_notify (GtkWidget *widget, GdkEventCrossing *event);
@@ -82,49 +126,212 @@ static gboolean fittsmenu_leave_notify (GtkWidget *widget, GdkEventCrossing *eve
 static gboolean fittsmenu_grab_notify (GtkWidget *widget, GdkEventCrossing *event);
 static gboolean fittsmenu_focus (GtkWidget *widget, GdkEventFocus *event);
 static void set_alpha (GtkWidget *widget);
+static const gchar *missing_icon_path (void);
+static gboolean display_is_remote (void);
+static void get_pointer_state (gint *x, gint *y, GdkModifierType *mask);
+static void fittsmenu_map (Fittsmenu *fittsmenu);
+static gboolean fittsmenu_mark_grab (Fittsmenu *fittsmenu);
+static void fittsmenu_mark_ungrab (Fittsmenu *fittsmenu);
+static gboolean fittsmenu_mark_motion (GtkWidget *widget, GdkEventMotion *event,
+                                       Fittsmenu *fittsmenu);
+static gboolean fittsmenu_mark_release (GtkWidget *widget, GdkEventButton *event,
+                                        Fittsmenu *fittsmenu);
+static gboolean fittsmenu_mark_pause (gpointer data);
+static gboolean fittsmenu_start_transition (Fittsmenu *fittsmenu, gboolean in);
+static void fittsmenu_stop_transition (Fittsmenu *fittsmenu);
+static gboolean fittsmenu_transition_step (gpointer data);
+#if !FITTSMENU_USE_GTK3
 static cairo_t *my_cairo_create (GdkWindow* window, Fittsmenu *fittsmenu);
+#endif
 static void canvas_reset(cairo_t* cr);
+static void canvas_begin (Fittsmenu *fittsmenu, cairo_t *cr);
+static void fittsmenu_update_shape (Fittsmenu *fittsmenu);
 #ifdef USE_GLITZ
 static void swap_buffers(Fittsmenu *fittsmenu);
 #endif //USE_GLITZ
-static void render(cairo_t* cr, Fittsmenu *fittsmenu);
-static void recpol(gdouble x, gdouble y, gdouble *pr, gdouble *pa);
-static void polrec(gdouble r, gdouble a, gdouble *px, gdouble *py);
 long get_time (void);
 static gboolean fittsmenu_window_event (GtkWidget *window, GdkEvent *event, GtkWidget *fittsmenu);
+#if !FITTSMENU_USE_GTK3
 static void fittsmenu_window_size_request (GtkWidget *window, GtkRequisition *requisition, Fittsmenu *fittsmenu);
+#endif
 #define FITTSMENU_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), FITTSMENU_TYPE, FittsmenuPrivate))
 
 typedef struct _FittsmenuPrivate  FittsmenuPrivate;
 
+/* The application's preview function, shared with the requests in flight
+ * so replacing it doesn't free user_data from under them */
+typedef struct
+{
+  gint                 ref_count;
+  FittsmenuPreviewFunc func;
+  gpointer             user_data;
+  GDestroyNotify       notify;
+} FittsmenuPreviewer;
+
+/* A preview being made, the data of its task */
+typedef struct
+{
+  FittsmenuPreviewer*  previewer;
+  fittsmenu_slice*     slice;
+  gint                 size;
+} FittsmenuPreviewRequest;
+
+/* A finished preview in the cache */
+typedef struct
+{
+  fittsmenu_slice*     slice;
+  gint                 size;
+  cairo_surface_t*     surface;
+} FittsmenuPreview;
+
+/* Groups of settings the render thread's core is told about */
+enum
+{
+  RENDER_SPRITES = 1 << 0,
+  RENDER_TINTS   = 1 << 1,
+  RENDER_STYLES  = 1 << 2,
+  RENDER_LOD     = 1 << 3,
+  RENDER_RINGS   = 1 << 4,
+  RENDER_PREVIEW = 1 << 5,
+  RENDER_ALL     = (1 << 6) - 1
+};
+
+/* Settings changed since the render thread last looked, a copy so the main
+ * loop can go on changing its own */
+typedef struct
+{
+  guint                changed;
+  guint                sprite_angles;
+  gsize                sprite_max;
+  gdouble              tints[FITTSMENU_STATE_LAST][4];
+  gboolean             tint_set[FITTSMENU_STATE_LAST];
+  FittsmenuSliceStyle  styles[FITTSMENU_STATE_LAST];
+  gboolean             style_set[FITTSMENU_STATE_LAST];
+  gboolean             lod_set;
+  gint                 lod_sizes[3];
+  FittsmenuRing*       rings;
+  guint                n_rings;
+  cairo_surface_t*     preview;
+} FittsmenuRenderSettings;
+
+static void render_settings_apply (FittsmenuRenderSettings *settings, FittsmenuCore *core);
+static void render_settings_free (FittsmenuRenderSettings *settings);
+static FittsmenuPreviewer* previewer_ref (FittsmenuPreviewer *previewer);
+static void previewer_unref (FittsmenuPreviewer *previewer);
+static void preview_request_free (gpointer data);
+static cairo_surface_t* preview_cache_lookup (FittsmenuPrivate *priv, fittsmenu_slice *slice, gint size);
+static void preview_cache_insert (FittsmenuPrivate *priv, fittsmenu_slice *slice, gint size, cairo_surface_t *surface);
+static void preview_cache_clear (FittsmenuPrivate *priv);
+
 struct _FittsmenuPrivate 
 {
-  GList*         slices;
-  
-  fittsmenu_slice*      active;
-  fittsmenu_slice*      hover;
-  
-  /* Widget Geometry */
-  gdouble        slice_width;
-  gdouble        menu_radius;
-  gdouble        menu_inner_radius;
-  
-  gint			 animation;
-  
-  /* Widget State */
-  gboolean       menu_over;
-  gint           menu_angle;
-  gint           menu_angle_offset;
-  gint           menu_angle_diff;
-  
-  /* Last known mouse state */
-  gdouble        mouse_angle;
-  gdouble        mouse_distance;
+  FittsmenuCore* core;
 
   /* Window Geometry */
   gint           window_x;
   gint           window_y;
   gint           window_size; // Width/Height are the same
+  
+  /* Without a compositor the window is shaped to the ring, this is the
+   * geometry the current shape was made for */
+  gboolean       shaped;
+  gint           shape_radius;
+  gint           shape_inner_radius;
+  gint           shape_preview_width;
+  gint           shape_preview_height;
+
+  /* Embedded mode draws into the host at this centre, without a toplevel */
+  gboolean       embedded;
+  gboolean       popped_up;
+  gdouble        embed_x;
+  gdouble        embed_y;
+
+  /* Marking, the button held since the popup, where it was pressed and
+   * where the pointer last moved to. The stroke is followed through an
+   * invisible window holding the pointer, the ring is only mapped once the
+   * pause timeout fires. */
+  gboolean       marking;
+  gint           marking_delay;
+  guint          mark_id;
+  GtkWidget*     mark_grab;
+
+  /* Drawing for a display across the network, see fittsmenu_set_remote() */
+  gboolean       remote;
+
+  /* Popup and popdown fades, done by the compositor through the window's
+   * opacity so the ring isn't drawn again for them */
+  gint           transition_time;
+  guint          transition_id;
+  gboolean       transition_in;
+  long           transition_last;
+  gdouble        opacity;
+  guint          mark_button;
+  gint           mark_x;
+  gint           mark_y;
+  gint           mark_last_x;
+  gint           mark_last_y;
+
+  /* Keeps the core advancing while it animates without pointer input */
+  guint          animate_id;
+
+  /* A wakeup for published contents is waiting on the main loop */
+  gint           publish_queued;
+  /* Likewise for slices changed in place */
+  gint           damage_queued;
+
+  /* Threaded rendering. render_core draws on render_thread from the
+   * snapshot, state and settings handed over under render_lock, into back,
+   * which is then swapped with front. The main loop only paints front. */
+  FittsmenuCore* render_core;
+  GThread*       render_thread;
+  GMutex         render_lock;
+  GCond          render_cond;
+  gboolean       render_requested;
+  gboolean       render_quit;
+  FittsmenuCoreState render_state;
+  FittsmenuRenderSettings* render_settings;
+  FittsmenuSnapshot* render_published;
+  cairo_surface_t* front;
+  cairo_surface_t* back;
+  guint          present_id;
+
+  /* Hover previews. The pointer resting on preview_slice for preview_delay
+   * starts a request, cancelled through preview_cancellable when it moves
+   * on. preview is the one shown, the newest few are in preview_cache. */
+  FittsmenuPreviewer* previewer;
+  gint           preview_delay;
+  guint          preview_id;
+  fittsmenu_slice* preview_slice;
+  GCancellable*  preview_cancellable;
+  cairo_surface_t* preview;
+  GQueue*        preview_cache;
+
+  /* Sprite cache settings, filled in the background while popped up */
+  guint          sprite_angles;
+  gsize          sprite_max;
+  guint          prerender_id;
+
+  /* Icon tints, kept to set up the render thread's core */
+  gdouble        tints[FITTSMENU_STATE_LAST][4];
+  gboolean       tint_set[FITTSMENU_STATE_LAST];
+
+  /* Slice styles set on the widget or taken from the theme */
+  gboolean       themed;
+  FittsmenuSliceStyle styles[FITTSMENU_STATE_LAST];
+  gboolean       style_set[FITTSMENU_STATE_LAST];
+
+  /* Level of detail sizes, if changed from the core's defaults */
+  gboolean       lod_set;
+  gint           lod_sizes[3];
+
+  /* Concentric rings, NULL for a single ring */
+  FittsmenuRing* rings;
+  guint          n_rings;
+
+#if FITTSMENU_USE_GTK3
+  /* Frame clock callback, installed while pointer updates are pending */
+  guint          tick_id;
+#endif
 
   /* Glitz Primitives */
 #ifdef USE_GLITZ
@@ -135,7 +342,6 @@ struct _FittsmenuPrivate
 #endif // USE_GLITZ
 
 	gboolean dispose_has_run;
-	long last_redraw;
 };
 
 enum
@@ -143,6 +349,7 @@ enum
   TICK_SIGNAL,
   REVOLUTION_SIGNAL,
   CLICKED_SIGNAL,
+  REDRAW_SIGNAL,
   LAST_SIGNAL
 };
 
@@ -155,7 +362,16 @@ enum
   PROP_0,
   PROP_MENU_RADIUS,
   PROP_MENU_INNER_RADIUS,
-  PROP_MENU_ANIMATION
+  PROP_MENU_ANIMATION,
+  PROP_EMBEDDED,
+  PROP_USAGE_ID,
+  PROP_MARKING,
+  PROP_MARKING_DELAY,
+  PROP_THREADED,
+  PROP_THEMED,
+  PROP_TRANSITION_TIME,
+  PROP_REMOTE,
+  PROP_PREVIEW_DELAY
 };
 
 /* Get a GType that corresponds to Fittsmenu. The first time this function is
@@ -208,29 +424,39 @@ fittsmenu_class_init (FittsmenuClass *klass)
 
   /* Override the standard functions for realize, expose, and size changes. */
   widget_class->realize = fittsmenu_realize;
+#if FITTSMENU_USE_GTK3
+  widget_class->get_preferred_width = fittsmenu_get_preferred_size;
+  widget_class->get_preferred_height = fittsmenu_get_preferred_size;
+  widget_class->draw = fittsmenu_draw;
+#else
   widget_class->size_request = fittsmenu_size_request;
+  widget_class->expose_event = fittsmenu_expose;
+  widget_class->hide_all = fittsmenu_hide_all;
+#endif
   widget_class->size_allocate = fittsmenu_size_allocate;  
   widget_class->show = fittsmenu_show;
-  widget_class->expose_event = fittsmenu_expose;
   widget_class->key_press_event = fittsmenu_key_press;
   widget_class->button_press_event = fittsmenu_button_press;
   widget_class->button_release_event = fittsmenu_button_release;
   widget_class->motion_notify_event = fittsmenu_motion_notify;  
+  widget_class->scroll_event = fittsmenu_scroll;
   widget_class->show_all = fittsmenu_show_all;
-  widget_class->hide_all = fittsmenu_hide_all;
   widget_class->enter_notify_event = fittsmenu_enter_notify;
   widget_class->leave_notify_event = fittsmenu_leave_notify;
+#if FITTSMENU_USE_GTK3
+  widget_class->style_updated = fittsmenu_style_updated;
+#else
+  widget_class->style_set = fittsmenu_style_set;
+#endif
   
   
   gobject_class->dispose = fittsmenu_dispose;
   gobject_class->finalize = fittsmenu_finalize;
   
-  //widget_class->style_set = fittsmenu_style_set;
   //widget_class->focus = fittsmenu_focus;
   //widget_class->can_activate_accel = fittsmenu_real_can_activate_accel;
   //widget_class->grab_notify = fittsmenu_grab_notify;
   
-  /* Add FittsmenuPrivate as a private data class of FittsmenuClass. */
   g_type_class_add_private (klass, sizeof (FittsmenuPrivate));
 
   fittsmenu_signals[TICK_SIGNAL] = 
@@ -256,6 +482,14 @@ fittsmenu_class_init (FittsmenuClass *klass)
                          G_STRUCT_OFFSET (FittsmenuClass, clicked),
                          NULL, NULL, g_cclosure_marshal_VOID__VOID,
                          G_TYPE_NONE, 0);
+
+  fittsmenu_signals[REDRAW_SIGNAL] = 
+           g_signal_new ("redraw-signal",
+                         G_TYPE_FROM_CLASS (klass),
+                         G_SIGNAL_RUN_FIRST | G_SIGNAL_ACTION,
+                         G_STRUCT_OFFSET (FittsmenuClass, redraw),
+                         NULL, NULL, g_cclosure_marshal_VOID__VOID,
+                         G_TYPE_NONE, 0);
   
   g_object_class_install_property (gobject_class, PROP_MENU_RADIUS,
               g_param_spec_double ("menu-radius",
@@ -277,6 +511,70 @@ fittsmenu_class_init (FittsmenuClass *klass)
                                    "How should the menu animate",
                                    0, 5, 1,
                                    G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_EMBEDDED,
+              g_param_spec_boolean ("embedded",
+                                    "Embedded",
+                                    "Draw into the host with fittsmenu_render instead of a popup window",
+                                    FALSE,
+                                    G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_USAGE_ID,
+              g_param_spec_string ("usage-id",
+                                   "Usage ID",
+                                   "Remember activations under this id and open towards the favourite",
+                                   NULL,
+                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MARKING,
+              g_param_spec_boolean ("marking",
+                                    "Marking",
+                                    "Select by stroke direction when popped up with a button held",
+                                    FALSE,
+                                    G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MARKING_DELAY,
+              g_param_spec_int ("marking-delay",
+                                "Marking delay",
+                                "Milliseconds the pointer must pause before a marking menu is shown",
+                                0, 5000, 300,
+                                G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_THREADED,
+              g_param_spec_boolean ("threaded",
+                                    "Threaded",
+                                    "Draw frames on a thread of their own, the main loop only presents them",
+                                    FALSE,
+                                    G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_THEMED,
+              g_param_spec_boolean ("themed",
+                                    "Themed",
+                                    "Colour the slices and icons from the widget's style",
+                                    FALSE,
+                                    G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_TRANSITION_TIME,
+              g_param_spec_int ("transition-time",
+                                "Transition time",
+                                "Milliseconds the popup window fades in and out for, when a compositor is running",
+                                0, 5000, 120,
+                                G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_REMOTE,
+              g_param_spec_boolean ("remote",
+                                    "Remote",
+                                    "Keep icons and cached frames on the X server, for displays across a network",
+                                    FALSE,
+                                    G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_PREVIEW_DELAY,
+              g_param_spec_int ("preview-delay",
+                                "Preview delay",
+                                "Milliseconds the pointer rests on a slice before its preview is asked for",
+                                0, 5000, 250,
+                                G_PARAM_READWRITE));
+ 
  }
 
 /* Initialize the actual Fittsmenu widget. This function is used to setup
@@ -287,22 +585,71 @@ fittsmenu_init (GtkWidget *widget)
   Fittsmenu *fittsmenu = FITTSMENU(widget);
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
   
-  rsvg_init();
-  priv->menu_radius = 120;
-  priv->menu_inner_radius = 80;
-  priv->window_size = priv->menu_radius * 2;
-  priv->menu_angle = 0;
-  priv->menu_angle_offset = 0;
-  priv->mouse_angle = 0;
-  priv->mouse_distance = 0;
-  priv->menu_over = FALSE;
-  priv->animation = FITTSMENU_ANIM_CROTATE;
+  priv->core = fittsmenu_core_new();
+  fittsmenu_core_set_missing_icon(priv->core, missing_icon_path());
+  fittsmenu_core_set_publish_notify(priv->core, fittsmenu_published, fittsmenu);
+  fittsmenu_core_set_damage_notify(priv->core, fittsmenu_damaged, fittsmenu);
+#if FITTSMENU_USE_GTK3
+  // The frame clock paces updates
+  fittsmenu_core_set_frame_interval(priv->core, 0);
+  priv->tick_id = 0;
+#endif
+  
+  priv->window_size = fittsmenu_core_get_menu_radius(priv->core) * 2;
   priv->dispose_has_run = FALSE;
-  priv->last_redraw = get_time() - 30000;
+  
+  priv->embedded = FALSE;
+  priv->popped_up = FALSE;
+  priv->shaped = FALSE;
+  priv->shape_radius = 0;
+  priv->shape_inner_radius = 0;
+  priv->shape_preview_width = 0;
+  priv->shape_preview_height = 0;
+  priv->publish_queued = FALSE;
+  priv->damage_queued = FALSE;
+  priv->animate_id = 0;
+  priv->marking = FALSE;
+  priv->marking_delay = 300;
+  priv->mark_id = 0;
+  priv->mark_grab = NULL;
+  priv->remote = display_is_remote();
+  fittsmenu_core_set_remote(priv->core, priv->remote);
+  priv->transition_time = 120;
+  priv->transition_id = 0;
+  priv->opacity = 1.0;
+  priv->render_core = NULL;
+  priv->render_thread = NULL;
+  priv->render_published = NULL;
+  priv->render_settings = NULL;
+  priv->front = NULL;
+  priv->back = NULL;
+  priv->present_id = 0;
+  priv->sprite_angles = 0;
+  priv->sprite_max = 0;
+  priv->prerender_id = 0;
+  priv->previewer = NULL;
+  priv->preview_delay = 250;
+  priv->preview_id = 0;
+  priv->preview_slice = NULL;
+  priv->preview_cancellable = NULL;
+  priv->preview = NULL;
+  priv->preview_cache = g_queue_new ();
+  fittsmenu->toplevel = NULL;
   
 #ifdef USE_GLITZ
   priv->nv_use_glitz = FALSE;
 #endif
+}
+
+/* Create the popup window the menu is drawn in, this is deferred until the
+ * first popup so that embedded menus never create an X window. */
+static void
+fittsmenu_create_toplevel (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (fittsmenu->toplevel)
+    return;
 
   /* Create window priv->toplevel */
   fittsmenu->toplevel = g_object_connect (g_object_new (GTK_TYPE_WINDOW,
@@ -310,7 +657,9 @@ fittsmenu_init (GtkWidget *widget)
                                                         "child", fittsmenu,
                                                         NULL),
                                           "object-signal::event", fittsmenu_window_event, fittsmenu,
+#if !FITTSMENU_USE_GTK3
                                           "object-signal::size_request", fittsmenu_window_size_request, fittsmenu,
+#endif
                                           "signal::destroy", gtk_widget_destroyed, &fittsmenu->toplevel,
                                           NULL);
 
@@ -424,6 +773,33 @@ fittsmenu_set_property (GObject *object,
     case PROP_MENU_INNER_RADIUS:
       fittsmenu_set_menu_inner_radius (fittsmenu, g_value_get_int (value));
       break;
+    case PROP_EMBEDDED:
+      fittsmenu_set_embedded (fittsmenu, g_value_get_boolean (value));
+      break;
+    case PROP_USAGE_ID:
+      fittsmenu_set_usage_id (fittsmenu, g_value_get_string (value));
+      break;
+    case PROP_MARKING:
+      fittsmenu_set_marking (fittsmenu, g_value_get_boolean (value));
+      break;
+    case PROP_MARKING_DELAY:
+      fittsmenu_set_marking_delay (fittsmenu, g_value_get_int (value));
+      break;
+    case PROP_THREADED:
+      fittsmenu_set_threaded (fittsmenu, g_value_get_boolean (value));
+      break;
+    case PROP_THEMED:
+      fittsmenu_set_themed (fittsmenu, g_value_get_boolean (value));
+      break;
+    case PROP_TRANSITION_TIME:
+      fittsmenu_set_transition_time (fittsmenu, g_value_get_int (value));
+      break;
+    case PROP_REMOTE:
+      fittsmenu_set_remote (fittsmenu, g_value_get_boolean (value));
+      break;
+    case PROP_PREVIEW_DELAY:
+      fittsmenu_set_preview_delay (fittsmenu, g_value_get_int (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -444,10 +820,37 @@ fittsmenu_get_property (GObject *object,
   switch (prop_id)
   {
     case PROP_MENU_RADIUS:
-      g_value_set_int (value, priv->menu_radius);
+      g_value_set_int (value, fittsmenu_core_get_menu_radius (priv->core));
       break;
     case PROP_MENU_INNER_RADIUS:
-      g_value_set_int (value, priv->menu_inner_radius);
+      g_value_set_int (value, fittsmenu_core_get_menu_inner_radius (priv->core));
+      break;
+    case PROP_EMBEDDED:
+      g_value_set_boolean (value, priv->embedded);
+      break;
+    case PROP_USAGE_ID:
+      g_value_set_string (value, fittsmenu_core_get_usage_id (priv->core));
+      break;
+    case PROP_MARKING:
+      g_value_set_boolean (value, priv->marking);
+      break;
+    case PROP_MARKING_DELAY:
+      g_value_set_int (value, priv->marking_delay);
+      break;
+    case PROP_THREADED:
+      g_value_set_boolean (value, priv->render_thread != NULL);
+      break;
+    case PROP_THEMED:
+      g_value_set_boolean (value, priv->themed);
+      break;
+    case PROP_TRANSITION_TIME:
+      g_value_set_int (value, priv->transition_time);
+      break;
+    case PROP_REMOTE:
+      g_value_set_boolean (value, priv->remote);
+      break;
+    case PROP_PREVIEW_DELAY:
+      g_value_set_int (value, priv->preview_delay);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -469,40 +872,63 @@ fittsmenu_realize (GtkWidget *widget)
 {
   Fittsmenu *fittsmenu;
   GdkWindowAttr attributes;
+  GtkAllocation allocation;
+  GdkWindow *window;
   gint attr_mask;
 
   g_return_if_fail (widget != NULL);
   g_return_if_fail (IS_FITTSMENU (widget));
 
-  /* Set the GTK_REALIZED flag so it is marked as realized. */
-  GTK_WIDGET_SET_FLAGS (widget, GTK_REALIZED);
+  /* Mark the widget as realized. */
+  gtk_widget_set_realized (widget, TRUE);
   fittsmenu = FITTSMENU (widget);
 
   /* Create a new GtkWindowAttr object that will hold info about the GdkWindow. */
-  attributes.x = widget->allocation.x;
-  attributes.y = widget->allocation.y;
-  attributes.width = widget->allocation.width;
-  attributes.height = widget->allocation.height;
+  gtk_widget_get_allocation (widget, &allocation);
+  attributes.x = allocation.x;
+  attributes.y = allocation.y;
+  attributes.width = allocation.width;
+  attributes.height = allocation.height;
   attributes.wclass = GDK_INPUT_OUTPUT;
   attributes.window_type = GDK_WINDOW_CHILD;
   attributes.event_mask = gtk_widget_get_events (widget);
   attributes.event_mask |= (GDK_EXPOSURE_MASK);
   attributes.visual = gtk_widget_get_visual (widget);
-  attributes.colormap = gtk_widget_get_colormap (widget);
   
   /* Create a new GdkWindow for the widget. */
+#if FITTSMENU_USE_GTK3
+  attr_mask = GDK_WA_X | GDK_WA_Y | GDK_WA_VISUAL;
+  window = gdk_window_new (gtk_widget_get_parent_window (widget), &attributes, attr_mask);
+  gtk_widget_set_window (widget, window);
+  gtk_widget_register_window (widget, window);
+#else
+  attributes.colormap = gtk_widget_get_colormap (widget);
   attr_mask = GDK_WA_X | GDK_WA_Y | GDK_WA_VISUAL | GDK_WA_COLORMAP;
-  widget->window = gdk_window_new (widget->parent->window, &attributes, attr_mask);
-  gdk_window_set_user_data (widget->window, fittsmenu);
+  window = gdk_window_new (gtk_widget_get_parent_window (widget), &attributes, attr_mask);
+  gtk_widget_set_window (widget, window);
+  gdk_window_set_user_data (window, fittsmenu);
 
   /* Attach a style to the GdkWindow and draw a background color. */
-  widget->style = gtk_style_attach (widget->style, widget->window);
-  gtk_style_set_background (widget->style, widget->window, GTK_STATE_NORMAL);
+  widget->style = gtk_style_attach (widget->style, window);
+  gtk_style_set_background (widget->style, window, GTK_STATE_NORMAL);
+#endif
   /* Not sure this should happen here...when a widget is shown it is first realized
    * then mapped. The default map function for a widget with a window calls this function*/
   //gdk_window_show (widget->window);
 }
 
+#if FITTSMENU_USE_GTK3
+/* Handle size requests for the widget. This function forces the widget to have
+ * an initial size set according to the predefined width. */
+static void
+fittsmenu_get_preferred_size (GtkWidget *widget,
+                              gint *minimum,
+                              gint *natural)
+{
+  *minimum = FITTSMENU_MIN_WIDTH;
+  *natural = FITTSMENU_MIN_WIDTH;
+}
+#else
 /* Handle size requests for the widget. This function forces the widget to have
  * an initial size set according to the predefined width and the font size. */
 static void 
@@ -515,6 +941,7 @@ fittsmenu_size_request (GtkWidget *widget,
   requisition->width = FITTSMENU_MIN_WIDTH;
   requisition->height = FITTSMENU_MIN_WIDTH;
 }
+#endif
 
 /* Handle size allocations for the widget. This does the actual resizing of the
  * widget to the requested allocation. */
@@ -522,17 +949,14 @@ static void
 fittsmenu_size_allocate (GtkWidget *widget,
                           GtkAllocation *allocation)
 {
-  Fittsmenu *fittsmenu = FITTSMENU(widget);
-  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
   g_return_if_fail (widget != NULL || allocation != NULL);
   g_return_if_fail (IS_FITTSMENU (widget));
 
-  widget->allocation = *allocation;
-  fittsmenu = FITTSMENU (widget);
+  gtk_widget_set_allocation (widget, allocation);
 
-  if (GTK_WIDGET_REALIZED (widget))
+  if (gtk_widget_get_realized (widget))
   {
-    gdk_window_move_resize (widget->window, allocation->x, allocation->y, 
+    gdk_window_move_resize (gtk_widget_get_window (widget), allocation->x, allocation->y, 
                             allocation->width, allocation->height);
   }
 }
@@ -544,17 +968,21 @@ fittsmenu_show (GtkWidget *widget)
 {
   Fittsmenu *fittsmenu = FITTSMENU (widget);
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint radius;
   gint x;
   gint y;
   
-  GdkDisplay *display;
-  GdkScreen  *screen;
+  // Already popped up, shown by a marking menu that paused
+  if (priv->popped_up) {
+    GTK_WIDGET_CLASS (fittsmenu_parent_class)->show (widget);
+    return;
+  }
   
-  display = gdk_display_get_default();
-  gdk_display_get_pointer (display, &screen, &x, &y, NULL);
+  get_pointer_state (&x, &y, NULL);
   
-  priv->window_x = x - priv->menu_radius;
-  priv->window_y = y - priv->menu_radius;
+  radius = fittsmenu_core_get_menu_radius (priv->core);
+  priv->window_x = x - radius;
+  priv->window_y = y - radius;
 
   GTK_WIDGET_CLASS (fittsmenu_parent_class)->show (widget);
                                                          
@@ -588,6 +1016,7 @@ fittsmenu_window_event (GtkWidget *window,
   return handled;
 }
 
+#if !FITTSMENU_USE_GTK3
 static void
 fittsmenu_window_size_request (GtkWidget      *window,
                                GtkRequisition *requisition,
@@ -609,7 +1038,46 @@ fittsmenu_window_size_request (GtkWidget      *window,
     }
   */
 }
+#endif
+
+#if FITTSMENU_USE_GTK3
+/* Draw the menu, the frame clock schedules this */
+static gboolean
+fittsmenu_draw (GtkWidget *widget,
+                cairo_t   *cr)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (widget);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+
+  canvas_begin(fittsmenu, cr);
+  if (priv->render_thread)
+    fittsmenu_paint_front (fittsmenu, cr);
+  else
+    fittsmenu_core_render (priv->core, cr);
+  
+  return FALSE;
+}
 
+/* Apply pointer motion once per frame, the callback goes away again once
+ * there is nothing left to apply */
+static gboolean
+fittsmenu_tick (GtkWidget     *widget,
+                GdkFrameClock *frame_clock,
+                gpointer       user_data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (widget);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (fittsmenu_core_advance (priv->core, gdk_frame_clock_get_frame_time (frame_clock)))
+    fittsmenu_queue_redraw (fittsmenu);
+  else if (!fittsmenu_core_is_animating (priv->core)) {
+    priv->tick_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+  
+  return G_SOURCE_CONTINUE;
+}
+#else
 /* This function is called when an expose-event occurs on the widget. This means
  * that a part of the widget that was previously hidden is shown. */
 static gint
@@ -617,14 +1085,27 @@ fittsmenu_expose (GtkWidget *widget,
                   GdkEventExpose *event)
 {
   Fittsmenu *fittsmenu = FITTSMENU (widget);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
   cairo_t* cr = NULL;
     
   cr = my_cairo_create (widget->window, fittsmenu);
   if (!cr)
     return FALSE;
 
-  canvas_reset(cr);
-  render (cr, fittsmenu);
+  // Only the exposed area is drawn, glitz swaps whole buffers
+#ifdef USE_GLITZ
+  if (!priv->nv_use_glitz)
+#endif
+  {
+    gdk_cairo_region (cr, event->region);
+    cairo_clip (cr);
+  }
+
+  canvas_begin(fittsmenu, cr);
+  if (priv->render_thread)
+    fittsmenu_paint_front (fittsmenu, cr);
+  else
+    fittsmenu_core_render (priv->core, cr);
 
 #ifdef USE_GLITZ
     /* swap the buffers after redraw */
@@ -634,13 +1115,34 @@ fittsmenu_expose (GtkWidget *widget,
   
   return FALSE;
 }
+#endif
 
 // On wheel rotate rotate the menu by one icon per
-// wheel pulse
+// wheel pulse, this only moves menus backed by a data source
 static gint
 fittsmenu_scroll (GtkWidget *widget,
-                  GdkEventExpose *event)
+                  GdkEventScroll *event)
 {
+  Fittsmenu *fittsmenu = FITTSMENU (widget);
+  gint delta;
+  
+  switch (event->direction) {
+    case GDK_SCROLL_UP:
+    case GDK_SCROLL_LEFT:
+      delta = -1;
+    break;
+    
+    case GDK_SCROLL_DOWN:
+    case GDK_SCROLL_RIGHT:
+      delta = 1;
+    break;
+    
+    default:
+      return FALSE;
+  }
+  
+  fittsmenu_inject_scroll (fittsmenu, delta);
+  return TRUE;
 }
 
 static gint
@@ -660,14 +1162,11 @@ fittsmenu_button_release (GtkWidget *widget,
                           GdkEventButton *event)
 {
 	Fittsmenu *fittsmenu = FITTSMENU (widget);
-  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
 
   if (event->type == GDK_BUTTON_RELEASE) {
     switch (event->button) {
       case 1: // Left
-				priv->active = priv->hover;
-        fittsmenu_popdown(fittsmenu);
-        g_signal_emit_by_name ((gpointer) fittsmenu, "clicked-signal");
+        fittsmenu_activate_hover(fittsmenu);
       break;
 
       case 2: //Middle
@@ -686,63 +1185,286 @@ fittsmenu_motion_notify (GtkWidget *widget,
                          GdkEventMotion *event)
 {
   Fittsmenu *fittsmenu = FITTSMENU (widget);
+#if FITTSMENU_USE_GTK3
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
   
-  // If we've redrawn less than 30000 usec ago don't redraw (33fps)
-  if (get_time() < priv->last_redraw + 30000)
-  	return TRUE; 
-  
+  // Recorded now, applied on the next frame
+  fittsmenu_core_pointer_motion (priv->core, event->x, event->y);
+  if (!priv->tick_id)
+    priv->tick_id = gtk_widget_add_tick_callback (widget, fittsmenu_tick, NULL, NULL);
+  return TRUE;
+#else
   gint mouse_x, mouse_y;
-  cairo_t* cr;
-  gint cx, cy;
-  gdouble rx, ry;
   
-  gdk_window_get_pointer (widget->window, &mouse_x, &mouse_y, NULL);
+  // The event's own co-ordinates save a round trip to the server, only
+  // hints need asking for the pointer
+  if (event->is_hint) {
+    gdk_window_get_pointer (widget->window, &mouse_x, &mouse_y, NULL);
+  } else {
+    mouse_x = event->x;
+    mouse_y = event->y;
+  }
+  return fittsmenu_pointer_moved (fittsmenu, mouse_x, mouse_y);
+#endif
+}
+
+/* Track the pointer, mouse_x and mouse_y are relative to the top left of the
+ * menu. Applied straight away, subject to the core's frame interval. */
+static gboolean
+fittsmenu_pointer_moved (Fittsmenu *fittsmenu,
+                         gint mouse_x, gint mouse_y)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  fittsmenu_core_pointer_motion (priv->core, mouse_x, mouse_y);
+  if (fittsmenu_core_advance (priv->core, get_time()))
+    fittsmenu_queue_redraw (fittsmenu);
+  
+  // Resting on the edge of a data source window keeps it scrolling
+  if (fittsmenu_core_is_animating (priv->core) && !priv->animate_id)
+    priv->animate_id = g_timeout_add (30, fittsmenu_animate, fittsmenu);
+  return TRUE;
+}
+
+static gboolean
+fittsmenu_animate (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (fittsmenu_core_advance (priv->core, get_time()))
+    fittsmenu_queue_redraw (fittsmenu);
+  
+  if (fittsmenu_core_is_animating (priv->core))
+    return TRUE;
+  
+  priv->animate_id = 0;
+  return FALSE;
+}
+
+static void
+fittsmenu_stop_animation (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (priv->animate_id)
+    g_source_remove (priv->animate_id);
+  priv->animate_id = 0;
+#if FITTSMENU_USE_GTK3
+  if (priv->tick_id)
+    gtk_widget_remove_tick_callback (GTK_WIDGET (fittsmenu), priv->tick_id);
+  priv->tick_id = 0;
+#endif
+}
+
+/* Select the slice under the pointer and close the menu */
+static void
+fittsmenu_activate_hover (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  fittsmenu_slice *slice;
+  
+  // A window fading out doesn't take clicks any more
+  if (!priv->popped_up)
+    return;
+  
+  slice = fittsmenu_core_activate(priv->core);
+  fittsmenu_popdown(fittsmenu);
+  // Missing the ring, or an insensitive slice, just closes it
+  if (slice)
+    g_signal_emit_by_name ((gpointer) fittsmenu, "clicked-signal");
+}
+
+/* Ask for a new frame, from the popup window or from the host when embedded */
+static void
+fittsmenu_queue_redraw (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  // The hover only ever changes along with a new frame
+  fittsmenu_preview_hover (fittsmenu);
+  
+  if (priv->embedded)
+    g_signal_emit (fittsmenu, fittsmenu_signals[REDRAW_SIGNAL], 0);
+  else if (priv->render_thread)
+    fittsmenu_request_frame (fittsmenu);
+  else
+    gtk_widget_queue_draw (GTK_WIDGET (fittsmenu));
+}
 
-  cx = priv->menu_radius;
-  cy = priv->menu_radius;
+/* Hand the render thread the current contents and pointer state, frames
+ * asked for before it gets round to them are drawn once from the newest */
+static void
+fittsmenu_request_frame (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  FittsmenuSnapshot *snapshot;
+  
+  fittsmenu_core_sync (priv->core);
+  snapshot = fittsmenu_core_get_snapshot (priv->core);
+  if (snapshot && snapshot != priv->render_published) {
+    if (priv->render_published)
+      fittsmenu_snapshot_unref (priv->render_published);
+    priv->render_published = fittsmenu_snapshot_ref (snapshot);
+    fittsmenu_core_publish (priv->render_core, snapshot);
+  }
+  
+  g_mutex_lock (&priv->render_lock);
+  fittsmenu_core_get_state (priv->core, &priv->render_state);
+  priv->render_requested = TRUE;
+  g_cond_signal (&priv->render_cond);
+  g_mutex_unlock (&priv->render_lock);
+}
 
-  ry = (cx - mouse_x)*-1;
-  rx = (cy - mouse_y);
+/* Draw frames as they are asked for, each into whichever buffer is not
+ * being presented. The render core belongs to this thread alone. */
+static gpointer
+fittsmenu_render_thread (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  FittsmenuRenderSettings *settings;
+  FittsmenuCoreState state;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gboolean prerender = FALSE;
+  guint sprite_angles = 0;
+  gint size;
+  
+  g_mutex_lock (&priv->render_lock);
+  for (;;) {
+    while (!priv->render_requested && !priv->render_settings && !priv->render_quit) {
+      // Fill the sprite cache between frames
+      if (prerender) {
+        g_mutex_unlock (&priv->render_lock);
+        prerender = fittsmenu_core_prerender (priv->render_core);
+        g_mutex_lock (&priv->render_lock);
+        continue;
+      }
+      g_cond_wait (&priv->render_cond, &priv->render_lock);
+    }
+    if (priv->render_quit)
+      break;
+    
+    // Settings first, the frame asked for with them should show them
+    settings = priv->render_settings;
+    priv->render_settings = NULL;
+    if (settings) {
+      if (settings->changed & RENDER_SPRITES)
+        sprite_angles = settings->sprite_angles;
+      g_mutex_unlock (&priv->render_lock);
+      render_settings_apply (settings, priv->render_core);
+      render_settings_free (settings);
+      prerender = sprite_angles > 0;
+      g_mutex_lock (&priv->render_lock);
+      continue;
+    }
     
-  recpol(rx,ry, &priv->mouse_distance, &priv->mouse_angle);
-  priv->mouse_angle = priv->mouse_angle * (180.0f/G_PI);
+    priv->render_requested = FALSE;
+    state = priv->render_state;
+    surface = priv->back;
+    priv->back = NULL;
+    g_mutex_unlock (&priv->render_lock);
     
-  // Left the menu area 
-  if ((priv->mouse_distance > priv->menu_radius) 
-      || (priv->mouse_distance < priv->menu_inner_radius - 10)) {
-    // Save the current position, to ensure when we enter the menu 
-    // doesn't jump around 
-    if (priv->animation == FITTSMENU_ANIM_CROTATE) {
-      priv->menu_angle_offset = priv->menu_angle;
-      priv->menu_angle_diff = 0;
+    size = state.menu_radius * 2;
+    if (surface && cairo_image_surface_get_width (surface) != size) {
+      cairo_surface_destroy (surface);
+      surface = NULL;
     }
-    priv->menu_over = FALSE;
-    gtk_widget_queue_draw (widget);
-    return TRUE;
-  }
+    if (!surface)
+      surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, size, size);
     
-  // Enter the menu area 
-  if (!priv->menu_over) {
-    // Apply the saved position on enter to the current menu angle
-    priv->menu_over = TRUE;
-		if (priv->animation == FITTSMENU_ANIM_CROTATE) {
-      priv->menu_angle_diff = (priv->menu_angle_offset + priv->mouse_angle)*-1;
-      priv->menu_angle_diff = priv->menu_angle_diff % 360;
-		}
+    fittsmenu_core_set_state (priv->render_core, &state);
+    cr = cairo_create (surface);
+    canvas_reset (cr);
+    fittsmenu_core_render (priv->render_core, cr);
+    cairo_destroy (cr);
+    prerender = sprite_angles > 0;
+    
+    g_mutex_lock (&priv->render_lock);
+    priv->back = priv->front;
+    priv->front = surface;
+    if (!priv->present_id)
+#if FITTSMENU_USE_GTK3
+      priv->present_id = g_idle_add (fittsmenu_present, fittsmenu);
+#else
+      priv->present_id = gdk_threads_add_idle (fittsmenu_present, fittsmenu);
+#endif
   }
-  // calculate the current menu angle based on the mouse angle 
-  if (priv->animation == FITTSMENU_ANIM_CROTATE)
-  	priv->menu_angle = (priv->mouse_angle + priv->menu_angle_diff)*-1;
+  g_mutex_unlock (&priv->render_lock);
+  
+  return NULL;
+}
 
-  // make sure the menuangle isn't negative or too large
-  priv->menu_angle = priv->menu_angle % 360;
-  if (priv->menu_angle < 0) 
-    priv->menu_angle = priv->menu_angle + 360;
+/* A frame is ready, have the popup window show it */
+static gboolean
+fittsmenu_present (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  g_mutex_lock (&priv->render_lock);
+  priv->present_id = 0;
+  g_mutex_unlock (&priv->render_lock);
+  
+  gtk_widget_queue_draw (GTK_WIDGET (fittsmenu));
+  return FALSE;
+}
 
-  priv->last_redraw = get_time();
-  gtk_widget_queue_draw (widget);
-  return TRUE;
+/* Paint the newest finished frame, the render thread may be drawing the
+ * next one meanwhile */
+static void
+fittsmenu_paint_front (Fittsmenu *fittsmenu, cairo_t *cr)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  g_mutex_lock (&priv->render_lock);
+  if (priv->front) {
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface (cr, priv->front, 0.0, 0.0);
+    cairo_paint (cr);
+  }
+  g_mutex_unlock (&priv->render_lock);
+}
+
+/* Join the render thread and drop everything it drew with */
+static void
+fittsmenu_stop_render_thread (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (!priv->render_thread)
+    return;
+  
+  g_mutex_lock (&priv->render_lock);
+  priv->render_quit = TRUE;
+  g_cond_signal (&priv->render_cond);
+  g_mutex_unlock (&priv->render_lock);
+  g_thread_join (priv->render_thread);
+  priv->render_thread = NULL;
+  
+  if (priv->present_id)
+    g_source_remove (priv->present_id);
+  priv->present_id = 0;
+  
+  if (priv->front)
+    cairo_surface_destroy (priv->front);
+  if (priv->back)
+    cairo_surface_destroy (priv->back);
+  priv->front = NULL;
+  priv->back = NULL;
+  
+  if (priv->render_published)
+    fittsmenu_snapshot_unref (priv->render_published);
+  priv->render_published = NULL;
+  if (priv->render_settings)
+    render_settings_free (priv->render_settings);
+  priv->render_settings = NULL;
+  fittsmenu_core_free (priv->render_core);
+  priv->render_core = NULL;
+  
+  g_mutex_clear (&priv->render_lock);
+  g_cond_clear (&priv->render_cond);
 }
 
 static gboolean
@@ -752,8 +1474,8 @@ fittsmenu_enter_notify (GtkWidget        *widget,
   Fittsmenu *fittsmenu = FITTSMENU (widget);
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
 	
-	priv->menu_angle_offset = priv->menu_angle;
-  priv->menu_over = FALSE;
+  fittsmenu_core_pointer_enter (priv->core);
+  return FALSE;
 }
 
 static gboolean
@@ -762,7 +1484,9 @@ fittsmenu_leave_notify (GtkWidget        *widget,
 {
 	Fittsmenu *fittsmenu = FITTSMENU (widget);
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
-  priv->menu_over = FALSE;
+  
+  fittsmenu_core_pointer_leave (priv->core);
+  return FALSE;
 }
 
 static gboolean
@@ -785,12 +1509,14 @@ fittsmenu_show_all (GtkWidget *widget)
 }
 
 
+#if !FITTSMENU_USE_GTK3
 static void
 fittsmenu_hide_all (GtkWidget *widget)
 {
   /* Hide children, but not self. */
   gtk_container_foreach (GTK_CONTAINER (widget), (GtkCallback) gtk_widget_hide_all, NULL);
 }
+#endif
 
 /* Actions */
 
@@ -800,111 +1526,1343 @@ fittsmenu_hide_all (GtkWidget *widget)
 void
 fittsmenu_append     (Fittsmenu *fittsmenu, fittsmenu_slice *slice)
 {
-  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
-
-  slice->icon_buffer = NULL;
-  priv->slices = g_list_append(priv->slices, (gpointer)slice);
-	slice->index = g_list_index(priv->slices, slice);
+  fittsmenu_core_append (FITTSMENU_GET_PRIVATE (fittsmenu)->core, slice);
 }
 
 void
 fittsmenu_remove     (Fittsmenu *fittsmenu, fittsmenu_slice *slice)
 {
-  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
-  priv->slices = g_list_remove(priv->slices, slice);
-  rsvg_handle_free (slice->icon_handle);
-  cairo_surface_destroy(slice->icon_buffer);
-  g_free(slice);
+  fittsmenu_core_remove (FITTSMENU_GET_PRIVATE (fittsmenu)->core, slice);
 }
 
 void
 fittsmenu_popup      (Fittsmenu *fittsmenu, guint button)
 {
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint radius;
   
-  if (g_list_length(priv->slices) < 1)
+  fittsmenu_core_sync(priv->core);
+  if (g_list_length(fittsmenu_core_get_slices(priv->core)) < 1)
   	return;
   
-  gtk_window_resize(GTK_WINDOW(fittsmenu->toplevel), priv->window_size, priv->window_size);
-  gtk_window_move(GTK_WINDOW(fittsmenu->toplevel), priv->window_x, priv->window_y);
-  gtk_widget_show(fittsmenu->toplevel);
+  priv->popped_up = TRUE;
+  fittsmenu_core_reset(priv->core);
   
-  gdk_pointer_grab (GTK_WIDGET(fittsmenu)->window, TRUE,
-		 GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
-		 GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK |
-		 GDK_POINTER_MOTION_MASK,
-		 NULL, NULL, 0);
+  if (priv->embedded) {
+    // The host draws us on its next frame
+    fittsmenu_queue_redraw(fittsmenu);
+    return;
+  }
+  
+  // GDK only tracks buttons 1 to 5 as held, any other gets the ring
+  // straight away
+  if (priv->marking && button >= 1 && button <= 5) {
+    // Nothing is drawn unless the pointer pauses, a stroke selects by
+    // its direction alone
+    get_pointer_state (&priv->mark_x, &priv->mark_y, NULL);
+    priv->mark_last_x = priv->mark_x;
+    priv->mark_last_y = priv->mark_y;
+    priv->mark_button = button;
+    if (fittsmenu_mark_grab(fittsmenu)) {
+      priv->mark_id = g_timeout_add (priv->marking_delay, fittsmenu_mark_pause, fittsmenu);
+      return;
+    }
+    
+    // Someone else has the pointer, fall back to the ring
+    radius = fittsmenu_core_get_menu_radius (priv->core);
+    priv->window_x = priv->mark_x - radius;
+    priv->window_y = priv->mark_y - radius;
+  }
+  
+  fittsmenu_map(fittsmenu);
 }
 
-void
-fittsmenu_popdown    (Fittsmenu *fittsmenu)
+/* Take the pointer from whoever popped us up, so the stroke and the release
+ * ending it come to us as events. Returns FALSE if the grab failed. */
+static gboolean
+fittsmenu_mark_grab (Fittsmenu *fittsmenu)
 {
-  gdk_display_pointer_ungrab (gdk_display_get_default(), GDK_CURRENT_TIME);
-  gdk_display_keyboard_ungrab (gdk_display_get_default(), GDK_CURRENT_TIME);
-  gtk_widget_hide(fittsmenu->toplevel);
-}
-
-
-/* Getters/Setters */
-void
-fittsmenu_set_animation         (Fittsmenu *fittsmenu, gint value)
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  GdkGrabStatus status;
+  
+  if (!priv->mark_grab) {
+    priv->mark_grab = gtk_invisible_new ();
+    gtk_widget_add_events (priv->mark_grab,
+                           GDK_POINTER_MOTION_MASK | GDK_BUTTON_RELEASE_MASK);
+    g_signal_connect (priv->mark_grab, "motion-notify-event",
+                      G_CALLBACK (fittsmenu_mark_motion), fittsmenu);
+    g_signal_connect (priv->mark_grab, "button-release-event",
+                      G_CALLBACK (fittsmenu_mark_release), fittsmenu);
+  }
+  gtk_widget_show (priv->mark_grab);
+  
+#if FITTSMENU_USE_GTK3
+  status = gdk_seat_grab (gdk_display_get_default_seat (gdk_display_get_default()),
+                          gtk_widget_get_window (priv->mark_grab),
+                          GDK_SEAT_CAPABILITY_ALL_POINTING, FALSE,
+                          NULL, NULL, NULL, NULL);
+#else
+  status = gdk_pointer_grab (gtk_widget_get_window (priv->mark_grab), FALSE,
+                             GDK_POINTER_MOTION_MASK | GDK_BUTTON_RELEASE_MASK,
+                             NULL, NULL, GDK_CURRENT_TIME);
+#endif
+  if (status != GDK_GRAB_SUCCESS) {
+    gtk_widget_hide (priv->mark_grab);
+    return FALSE;
+  }
+  gtk_grab_add (priv->mark_grab);
+  return TRUE;
+}
+
+/* Stop following a stroke, before the ring takes the pointer or the menu
+ * goes */
+static void
+fittsmenu_mark_ungrab (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (priv->mark_id)
+    g_source_remove (priv->mark_id);
+  priv->mark_id = 0;
+  
+  if (!priv->mark_grab || !gtk_widget_get_visible (priv->mark_grab))
+    return;
+  
+  gtk_grab_remove (priv->mark_grab);
+#if FITTSMENU_USE_GTK3
+  gdk_seat_ungrab (gdk_display_get_default_seat (gdk_display_get_default()));
+#else
+  gdk_display_pointer_ungrab (gdk_display_get_default(), GDK_CURRENT_TIME);
+#endif
+  gtk_widget_hide (priv->mark_grab);
+}
+
+/* The pointer moving on restarts the wait for a pause */
+static gboolean
+fittsmenu_mark_motion (GtkWidget *widget, GdkEventMotion *event, Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint x, y;
+  
+  x = event->x_root;
+  y = event->y_root;
+  if (ABS(x - priv->mark_last_x) <= 4 && ABS(y - priv->mark_last_y) <= 4)
+    return TRUE;
+  
+  priv->mark_last_x = x;
+  priv->mark_last_y = y;
+  if (priv->mark_id)
+    g_source_remove (priv->mark_id);
+  priv->mark_id = g_timeout_add (priv->marking_delay, fittsmenu_mark_pause, fittsmenu);
+  return TRUE;
+}
+
+/* The stroke ends, select along it or show the ring for a click */
+static gboolean
+fittsmenu_mark_release (GtkWidget *widget, GdkEventButton *event, Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  fittsmenu_slice *slice;
+  gint dx, dy, radius;
+  
+  if (event->button != priv->mark_button)
+    return TRUE;
+  
+  fittsmenu_mark_ungrab(fittsmenu);
+  dx = event->x_root - priv->mark_x;
+  dy = event->y_root - priv->mark_y;
+  
+  // A click rather than a mark, show the ring to pick from
+  if (dx*dx + dy*dy < FITTSMENU_MARK_MIN * FITTSMENU_MARK_MIN) {
+    radius = fittsmenu_core_get_menu_radius (priv->core);
+    priv->window_x = priv->mark_x - radius;
+    priv->window_y = priv->mark_y - radius;
+    fittsmenu_map(fittsmenu);
+    return TRUE;
+  }
+  
+  slice = fittsmenu_core_mark(priv->core, dx, dy);
+  fittsmenu_popdown(fittsmenu);
+  if (slice)
+    g_signal_emit_by_name ((gpointer) fittsmenu, "clicked-signal");
+  return TRUE;
+}
+
+/* The user paused, show the ring where the button went down */
+static gboolean
+fittsmenu_mark_pause (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint radius;
+  
+  priv->mark_id = 0;
+  fittsmenu_mark_ungrab(fittsmenu);
+  radius = fittsmenu_core_get_menu_radius (priv->core);
+  priv->window_x = priv->mark_x - radius;
+  priv->window_y = priv->mark_y - radius;
+  fittsmenu_map(fittsmenu);
+  return FALSE;
+}
+
+/* Show the popup window and take the pointer */
+static void
+fittsmenu_map (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  gtk_widget_show(GTK_WIDGET(fittsmenu));
+  fittsmenu_create_toplevel(fittsmenu);
+  fittsmenu_update_shape(fittsmenu);
+  gtk_window_resize(GTK_WINDOW(fittsmenu->toplevel), priv->window_size, priv->window_size);
+  gtk_window_move(GTK_WINDOW(fittsmenu->toplevel), priv->window_x, priv->window_y);
+  
+  // Fade in from transparent, or back from wherever a fade out got to
+  gtk_widget_realize(fittsmenu->toplevel);
+  if (!gtk_widget_get_visible (fittsmenu->toplevel))
+    priv->opacity = 0.0;
+  if (!fittsmenu_start_transition(fittsmenu, TRUE)) {
+    fittsmenu_stop_transition(fittsmenu);
+    priv->opacity = 1.0;
+  }
+  gdk_window_set_opacity (gtk_widget_get_window (fittsmenu->toplevel), priv->opacity);
+  gtk_widget_show(fittsmenu->toplevel);
+  if (priv->render_thread)
+    fittsmenu_request_frame(fittsmenu);
+  else if (priv->sprite_angles && !priv->prerender_id)
+    priv->prerender_id = g_idle_add_full (G_PRIORITY_LOW, fittsmenu_prerender, fittsmenu, NULL);
+  
+#if FITTSMENU_USE_GTK3
+  gdk_seat_grab (gdk_display_get_default_seat (gdk_display_get_default()),
+                 gtk_widget_get_window (GTK_WIDGET(fittsmenu)),
+                 GDK_SEAT_CAPABILITY_ALL_POINTING, TRUE,
+                 NULL, NULL, NULL, NULL);
+#else
+  gdk_pointer_grab (GTK_WIDGET(fittsmenu)->window, TRUE,
+		 GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
+		 GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK |
+		 GDK_POINTER_MOTION_MASK | GDK_SCROLL_MASK,
+		 NULL, NULL, 0);
+#endif
+}
+
+void
+fittsmenu_popdown    (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  priv->popped_up = FALSE;
+  fittsmenu_stop_animation(fittsmenu);
+  fittsmenu_mark_ungrab(fittsmenu);
+  fittsmenu_preview_hover(fittsmenu);
+  
+  if (priv->embedded) {
+    fittsmenu_queue_redraw(fittsmenu);
+    return;
+  }
+  
+  // A marking menu may finish without ever being shown
+  if (!fittsmenu->toplevel || !gtk_widget_get_visible (fittsmenu->toplevel))
+    return;
+  
+#if FITTSMENU_USE_GTK3
+  gdk_seat_ungrab (gdk_display_get_default_seat (gdk_display_get_default()));
+#else
+  gdk_display_pointer_ungrab (gdk_display_get_default(), GDK_CURRENT_TIME);
+  gdk_display_keyboard_ungrab (gdk_display_get_default(), GDK_CURRENT_TIME);
+#endif
+  if (!fittsmenu_start_transition(fittsmenu, FALSE))
+    gtk_widget_hide(fittsmenu->toplevel);
+}
+
+/* Fade the popup window in or out. The compositor blends the last frame,
+ * nothing is drawn for the fade itself. Returns FALSE when there is no
+ * compositor to do it, or fades are off. */
+static gboolean
+fittsmenu_start_transition (Fittsmenu *fittsmenu, gboolean in)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (!priv->transition_time
+      || !gdk_screen_is_composited (gtk_widget_get_screen (fittsmenu->toplevel)))
+    return FALSE;
+  
+  priv->transition_in = in;
+  priv->transition_last = get_time();
+  if (!priv->transition_id)
+    priv->transition_id = g_timeout_add (15, fittsmenu_transition_step, fittsmenu);
+  return TRUE;
+}
+
+static void
+fittsmenu_stop_transition (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (priv->transition_id)
+    g_source_remove (priv->transition_id);
+  priv->transition_id = 0;
+}
+
+static gboolean
+fittsmenu_transition_step (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gdouble step;
+  long now;
+  
+  now = get_time();
+  step = (now - priv->transition_last) / (priv->transition_time * 1000.0);
+  priv->transition_last = now;
+  
+  if (priv->transition_in)
+    priv->opacity = MIN(priv->opacity + step, 1.0);
+  else
+    priv->opacity = MAX(priv->opacity - step, 0.0);
+  gdk_window_set_opacity (gtk_widget_get_window (fittsmenu->toplevel), priv->opacity);
+  
+  if (priv->transition_in ? priv->opacity < 1.0 : priv->opacity > 0.0)
+    return TRUE;
+  
+  priv->transition_id = 0;
+  if (!priv->transition_in)
+    gtk_widget_hide(fittsmenu->toplevel);
+  return FALSE;
+}
+
+
+/* Getters/Setters */
+void
+fittsmenu_set_animation         (Fittsmenu *fittsmenu, gint value)
+{
+  fittsmenu_core_set_animation (FITTSMENU_GET_PRIVATE (fittsmenu)->core, value);
+}
+
+gint
+fittsmenu_get_animation         (Fittsmenu *fittsmenu)
+{
+  return fittsmenu_core_get_animation (FITTSMENU_GET_PRIVATE (fittsmenu)->core);
+}
+
+void
+fittsmenu_set_menu_radius       (Fittsmenu *fittsmenu, gint value)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+	gint x, y, radius;
+  
+  radius = fittsmenu_core_get_menu_radius (priv->core);
+  x = priv->window_x + radius;
+  y = priv->window_y + radius;
+  
+  fittsmenu_core_set_menu_radius (priv->core, value);
+	priv->window_size = value * 2;
+	
+  priv->window_x = x - value;
+  priv->window_y = y - value;
+
+  if (!fittsmenu->toplevel)
+    return;
+  
+  fittsmenu_update_shape(fittsmenu);
+  gtk_window_resize(GTK_WINDOW(fittsmenu->toplevel), priv->window_size, priv->window_size);
+  gtk_window_move(GTK_WINDOW(fittsmenu->toplevel), priv->window_x, priv->window_y);
+}
+
+gint
+fittsmenu_get_menu_radius       (Fittsmenu *fittsmenu)
+{
+  return fittsmenu_core_get_menu_radius (FITTSMENU_GET_PRIVATE (fittsmenu)->core);
+}
+
+void
+fittsmenu_set_menu_inner_radius (Fittsmenu *fittsmenu, gint value)
+{
+  fittsmenu_core_set_menu_inner_radius (FITTSMENU_GET_PRIVATE (fittsmenu)->core, value);
+  if (fittsmenu->toplevel)
+    fittsmenu_update_shape(fittsmenu);
+}
+
+gint
+fittsmenu_get_menu_inner_radius (Fittsmenu *fittsmenu)
+{
+  return fittsmenu_core_get_menu_inner_radius (FITTSMENU_GET_PRIVATE (fittsmenu)->core);
+}
+
+void
+fittsmenu_set_embedded (Fittsmenu *fittsmenu, gboolean value)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (priv->embedded == value)
+    return;
+  
+  if (priv->popped_up)
+    fittsmenu_popdown(fittsmenu);
+  priv->embedded = value;
+  fittsmenu_core_set_overlay(priv->core, value);
+}
+
+gboolean
+fittsmenu_get_embedded (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->embedded;
+}
+
+void
+fittsmenu_set_usage_id (Fittsmenu *fittsmenu, const gchar *menu_id)
+{
+  fittsmenu_core_set_usage_id (FITTSMENU_GET_PRIVATE (fittsmenu)->core, menu_id);
+}
+
+const gchar*
+fittsmenu_get_usage_id (Fittsmenu *fittsmenu)
+{
+  return fittsmenu_core_get_usage_id (FITTSMENU_GET_PRIVATE (fittsmenu)->core);
+}
+
+/* Marking menus select by stroke direction when popped up with a button
+ * held, the ring is only shown if the pointer pauses for delay ms */
+void
+fittsmenu_set_marking (Fittsmenu *fittsmenu, gboolean value)
+{
+  FITTSMENU_GET_PRIVATE (fittsmenu)->marking = value;
+}
+
+gboolean
+fittsmenu_get_marking (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->marking;
+}
+
+void
+fittsmenu_set_marking_delay (Fittsmenu *fittsmenu, gint delay)
+{
+  FITTSMENU_GET_PRIVATE (fittsmenu)->marking_delay = delay;
+}
+
+gint
+fittsmenu_get_marking_delay (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->marking_delay;
+}
+
+/* Draw for a display across the network, such as ssh -X. Icons and sprites
+ * are kept on the X server and composited there each frame, and frames are
+ * not drawn on a thread. On by default for X displays named with a host. */
+void
+fittsmenu_set_remote (Fittsmenu *fittsmenu, gboolean value)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  priv->remote = value;
+  fittsmenu_core_set_remote (priv->core, value);
+  if (value)
+    fittsmenu_stop_render_thread (fittsmenu);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+gboolean
+fittsmenu_get_remote (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->remote;
+}
+
+/* Milliseconds the popup window fades in and out for, 0 shows and hides it
+ * at once. Without a compositor there are no fades. */
+void
+fittsmenu_set_transition_time (Fittsmenu *fittsmenu, gint msec)
+{
+  FITTSMENU_GET_PRIVATE (fittsmenu)->transition_time = msec;
+}
+
+gint
+fittsmenu_get_transition_time (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->transition_time;
+}
+
+void
+fittsmenu_set_preview_delay (Fittsmenu *fittsmenu, gint msec)
+{
+  FITTSMENU_GET_PRIVATE (fittsmenu)->preview_delay = msec;
+}
+
+gint
+fittsmenu_get_preview_delay (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->preview_delay;
+}
+
+/* Draw frames on a thread of their own so a busy main loop does not stall
+ * the menu, nor a slow frame the input. Has no effect on embedded menus,
+ * which the host draws. */
+void
+fittsmenu_set_threaded (Fittsmenu *fittsmenu, gboolean value)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (value == (priv->render_thread != NULL))
+    return;
+  
+  // Finished frames are client side images, each would cross the network
+  // whole
+  if (value && priv->remote) {
+    g_printerr ("Fittsmenu: remote menus are not threaded, set remote off first\n");
+    return;
+  }
+  
+  if (!value) {
+    fittsmenu_stop_render_thread (fittsmenu);
+    return;
+  }
+  
+  priv->render_core = fittsmenu_core_new ();
+  fittsmenu_core_set_missing_icon (priv->render_core, missing_icon_path());
+  g_mutex_init (&priv->render_lock);
+  g_cond_init (&priv->render_cond);
+  priv->render_requested = FALSE;
+  priv->render_quit = FALSE;
+  // Everything set so far, the thread applies it before its first frame
+  fittsmenu_forward_settings (fittsmenu, RENDER_ALL);
+  priv->render_thread = g_thread_new ("fittsmenu-render", fittsmenu_render_thread, fittsmenu);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+gboolean
+fittsmenu_get_threaded (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->render_thread != NULL;
+}
+
+/* Only the thread may touch its core. Settings are copied for it under
+ * render_lock and applied before its next frame, so its sprites, rasters
+ * and buffers outlive a change of style. */
+static void
+fittsmenu_forward_settings (Fittsmenu *fittsmenu, guint changed)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  FittsmenuRenderSettings *settings;
+  
+  if (!priv->render_core)
+    return;
+  
+  g_mutex_lock (&priv->render_lock);
+  settings = priv->render_settings;
+  if (!settings)
+    settings = priv->render_settings = g_slice_new0 (FittsmenuRenderSettings);
+  settings->changed |= changed;
+  
+  if (changed & RENDER_SPRITES) {
+    settings->sprite_angles = priv->sprite_angles;
+    settings->sprite_max = priv->sprite_max;
+  }
+  if (changed & RENDER_TINTS) {
+    memcpy (settings->tints, priv->tints, sizeof (priv->tints));
+    memcpy (settings->tint_set, priv->tint_set, sizeof (priv->tint_set));
+  }
+  if (changed & RENDER_STYLES) {
+    memcpy (settings->styles, priv->styles, sizeof (priv->styles));
+    memcpy (settings->style_set, priv->style_set, sizeof (priv->style_set));
+  }
+  if (changed & RENDER_LOD) {
+    settings->lod_set = priv->lod_set;
+    memcpy (settings->lod_sizes, priv->lod_sizes, sizeof (priv->lod_sizes));
+  }
+  if (changed & RENDER_RINGS) {
+    g_free (settings->rings);
+    settings->n_rings = priv->n_rings;
+    settings->rings = NULL;
+    if (priv->n_rings) {
+      settings->rings = g_new (FittsmenuRing, priv->n_rings);
+      memcpy (settings->rings, priv->rings, sizeof (FittsmenuRing) * priv->n_rings);
+    }
+  }
+  if (changed & RENDER_PREVIEW) {
+    if (settings->preview)
+      cairo_surface_destroy (settings->preview);
+    settings->preview = priv->preview ? cairo_surface_reference (priv->preview) : NULL;
+  }
+  
+  g_cond_signal (&priv->render_cond);
+  g_mutex_unlock (&priv->render_lock);
+}
+
+/* On the render thread, only what changed so the rest of its caches stay */
+static void
+render_settings_apply (FittsmenuRenderSettings *settings, FittsmenuCore *core)
+{
+  gint i;
+  
+  if (settings->changed & RENDER_SPRITES)
+    fittsmenu_core_set_sprite_cache (core, settings->sprite_angles, settings->sprite_max);
+  if (settings->changed & RENDER_TINTS)
+    for (i = 0; i < FITTSMENU_STATE_LAST; i++) {
+      if (settings->tint_set[i])
+        fittsmenu_core_set_icon_tint (core, i, settings->tints[i][0], settings->tints[i][1],
+                                      settings->tints[i][2], settings->tints[i][3]);
+      else
+        fittsmenu_core_unset_icon_tint (core, i);
+    }
+  if (settings->changed & RENDER_STYLES)
+    for (i = 0; i < FITTSMENU_STATE_LAST; i++)
+      fittsmenu_core_set_slice_style (core, i, settings->style_set[i] ? &settings->styles[i] : NULL);
+  if ((settings->changed & RENDER_LOD) && settings->lod_set)
+    fittsmenu_core_set_lod_sizes (core, settings->lod_sizes[0], settings->lod_sizes[1],
+                                  settings->lod_sizes[2]);
+  if (settings->changed & RENDER_RINGS)
+    fittsmenu_core_set_rings (core, settings->rings, settings->n_rings);
+  if (settings->changed & RENDER_PREVIEW)
+    fittsmenu_core_set_preview (core, settings->preview);
+}
+
+static void
+render_settings_free (FittsmenuRenderSettings *settings)
+{
+  g_free (settings->rings);
+  if (settings->preview)
+    cairo_surface_destroy (settings->preview);
+  g_slice_free (FittsmenuRenderSettings, settings);
+}
+
+/* Trade memory for CPU, see fittsmenu_core_set_sprite_cache(). The cache
+ * is filled in the background while the menu is up. */
+void
+fittsmenu_set_sprite_cache (Fittsmenu *fittsmenu, guint n_angles, gsize max_bytes)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  priv->sprite_angles = n_angles;
+  priv->sprite_max = max_bytes;
+  fittsmenu_core_set_sprite_cache (priv->core, n_angles, max_bytes);
+  fittsmenu_forward_settings (fittsmenu, RENDER_SPRITES);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+/* Colour single colour icons are drawn in for a FITTSMENU_STATE_* state */
+void
+fittsmenu_set_icon_tint (Fittsmenu *fittsmenu, gint tint,
+                         gdouble red, gdouble green, gdouble blue, gdouble alpha)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  g_return_if_fail (tint >= 0 && tint < FITTSMENU_STATE_LAST);
+  
+  priv->tints[tint][0] = red;
+  priv->tints[tint][1] = green;
+  priv->tints[tint][2] = blue;
+  priv->tints[tint][3] = alpha;
+  priv->tint_set[tint] = TRUE;
+  fittsmenu_core_set_icon_tint (priv->core, tint, red, green, blue, alpha);
+  fittsmenu_forward_settings (fittsmenu, RENDER_TINTS);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+void
+fittsmenu_unset_icon_tint (Fittsmenu *fittsmenu, gint tint)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  g_return_if_fail (tint >= 0 && tint < FITTSMENU_STATE_LAST);
+  
+  priv->tint_set[tint] = FALSE;
+  fittsmenu_core_unset_icon_tint (priv->core, tint);
+  fittsmenu_forward_settings (fittsmenu, RENDER_TINTS);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+/* Fill and outline of slices in a FITTSMENU_STATE_*, NULL for the default.
+ * A themed menu replaces these whenever the theme changes. */
+void
+fittsmenu_set_slice_style (Fittsmenu *fittsmenu, gint state, const FittsmenuSliceStyle *style)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  g_return_if_fail (state >= 0 && state < FITTSMENU_STATE_LAST);
+  
+  priv->style_set[state] = style != NULL;
+  if (style)
+    priv->styles[state] = *style;
+  fittsmenu_core_set_slice_style (priv->core, state, style);
+  fittsmenu_forward_settings (fittsmenu, RENDER_STYLES);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+/* Follow the widget's style for slice colours and icon tints. Turning it
+ * off goes back to the default look. */
+void
+fittsmenu_set_themed (Fittsmenu *fittsmenu, gboolean value)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint i;
+  
+  if (priv->themed == value)
+    return;
+  
+  priv->themed = value;
+  if (value) {
+    fittsmenu_apply_theme (fittsmenu);
+    return;
+  }
+  
+  for (i = 0; i < FITTSMENU_STATE_LAST; i++) {
+    priv->style_set[i] = FALSE;
+    priv->tint_set[i] = FALSE;
+    fittsmenu_core_set_slice_style (priv->core, i, NULL);
+    fittsmenu_core_unset_icon_tint (priv->core, i);
+  }
+  fittsmenu_forward_settings (fittsmenu, RENDER_STYLES | RENDER_TINTS);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+gboolean
+fittsmenu_get_themed (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->themed;
+}
+
+/* Build slice styles from the theme's background colours, shaded towards
+ * the centre, and tint icons with the matching text colours */
+static void
+fittsmenu_apply_theme (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  GtkWidget *widget = GTK_WIDGET (fittsmenu);
+  FittsmenuSliceStyle *style;
+  gdouble bg[FITTSMENU_STATE_LAST][3], fg[FITTSMENU_STATE_LAST][3];
+  gint i, c;
+#if FITTSMENU_USE_GTK3
+  GtkStyleContext *context;
+#else
+  static const GtkStateType gtk_states[FITTSMENU_STATE_LAST] =
+    { GTK_STATE_NORMAL, GTK_STATE_PRELIGHT, GTK_STATE_SELECTED, GTK_STATE_INSENSITIVE };
+  GtkStyle *gtk_style;
+#endif
+  
+  if (!priv->themed)
+    return;
+  
+#if FITTSMENU_USE_GTK3
+  // GTK+ 3 themes name no hover colour, the normal one is lightened
+  context = gtk_widget_get_style_context (widget);
+  theme_colour (context, "theme_bg_color", bg[FITTSMENU_STATE_NORMAL]);
+  theme_colour (context, "theme_fg_color", fg[FITTSMENU_STATE_NORMAL]);
+  theme_colour (context, "theme_selected_bg_color", bg[FITTSMENU_STATE_ACTIVE]);
+  theme_colour (context, "theme_selected_fg_color", fg[FITTSMENU_STATE_ACTIVE]);
+  theme_colour (context, "insensitive_bg_color", bg[FITTSMENU_STATE_DISABLED]);
+  theme_colour (context, "insensitive_fg_color", fg[FITTSMENU_STATE_DISABLED]);
+  for (c = 0; c < 3; c++) {
+    bg[FITTSMENU_STATE_HOVER][c] = MIN(bg[FITTSMENU_STATE_NORMAL][c] * 1.15, 1.0);
+    fg[FITTSMENU_STATE_HOVER][c] = fg[FITTSMENU_STATE_NORMAL][c];
+  }
+#else
+  gtk_style = gtk_widget_get_style (widget);
+  for (i = 0; i < FITTSMENU_STATE_LAST; i++) {
+    bg[i][0] = gtk_style->bg[gtk_states[i]].red / 65535.0;
+    bg[i][1] = gtk_style->bg[gtk_states[i]].green / 65535.0;
+    bg[i][2] = gtk_style->bg[gtk_states[i]].blue / 65535.0;
+    fg[i][0] = gtk_style->fg[gtk_states[i]].red / 65535.0;
+    fg[i][1] = gtk_style->fg[gtk_states[i]].green / 65535.0;
+    fg[i][2] = gtk_style->fg[gtk_states[i]].blue / 65535.0;
+  }
+#endif
+  
+  for (i = 0; i < FITTSMENU_STATE_LAST; i++) {
+    style = &priv->styles[i];
+    for (c = 0; c < 3; c++) {
+      style->fill_inner[c] = bg[i][c] * .8;
+      style->fill_outer[c] = bg[i][c];
+      style->stroke[c] = bg[i][c] * .6;
+      priv->tints[i][c] = fg[i][c];
+    }
+    style->fill_inner[3] = style->fill_outer[3] = .85;
+    style->stroke[3] = .5;
+    style->stroke_width = 3;
+    priv->tints[i][3] = 1.0;
+    priv->style_set[i] = TRUE;
+    priv->tint_set[i] = TRUE;
+    
+    fittsmenu_core_set_slice_style (priv->core, i, style);
+    fittsmenu_core_set_icon_tint (priv->core, i, fg[i][0], fg[i][1], fg[i][2], 1.0);
+  }
+  fittsmenu_forward_settings (fittsmenu, RENDER_STYLES | RENDER_TINTS);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+#if FITTSMENU_USE_GTK3
+static void
+fittsmenu_style_updated (GtkWidget *widget)
+{
+  GTK_WIDGET_CLASS (fittsmenu_parent_class)->style_updated (widget);
+  fittsmenu_apply_theme (FITTSMENU (widget));
+}
+
+/* A named colour of the theme, grey if it doesn't define one */
+static void
+theme_colour (GtkStyleContext *context, const gchar *name, gdouble *rgb)
+{
+  GdkRGBA colour;
+  
+  if (!gtk_style_context_lookup_color (context, name, &colour))
+    colour.red = colour.green = colour.blue = .5;
+  rgb[0] = colour.red;
+  rgb[1] = colour.green;
+  rgb[2] = colour.blue;
+}
+#else
+static void
+fittsmenu_style_set (GtkWidget *widget, GtkStyle *previous_style)
+{
+  fittsmenu_apply_theme (FITTSMENU (widget));
+}
+#endif
+
+/* Smallest icon sizes drawn as an icon, a letter or a swatch, see
+ * fittsmenu_core_set_lod_sizes() */
+void
+fittsmenu_set_lod_sizes (Fittsmenu *fittsmenu, gint icon_min, gint glyph_min, gint swatch_min)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  priv->lod_set = TRUE;
+  priv->lod_sizes[0] = icon_min;
+  priv->lod_sizes[1] = glyph_min;
+  priv->lod_sizes[2] = swatch_min;
+  fittsmenu_core_set_lod_sizes (priv->core, icon_min, glyph_min, swatch_min);
+  fittsmenu_forward_settings (fittsmenu, RENDER_LOD);
+  
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+/* Lay the slices out over concentric rings, see fittsmenu_core_set_rings() */
+void
+fittsmenu_set_rings (Fittsmenu *fittsmenu, const FittsmenuRing *rings, guint n_rings)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  g_free (priv->rings);
+  priv->n_rings = rings ? n_rings : 0;
+  priv->rings = NULL;
+  if (priv->n_rings) {
+    priv->rings = g_new (FittsmenuRing, priv->n_rings);
+    memcpy (priv->rings, rings, sizeof (FittsmenuRing) * priv->n_rings);
+  }
+  fittsmenu_core_set_rings (priv->core, priv->rings, priv->n_rings);
+  fittsmenu_forward_settings (fittsmenu, RENDER_RINGS);
+  
+  // The shape follows the rings, not just the radii it is kept for
+  priv->shape_radius = 0;
+  if (fittsmenu->toplevel)
+    fittsmenu_update_shape (fittsmenu);
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+/* Bytes held by the sprite cache of the core that draws the menu */
+gsize
+fittsmenu_get_sprite_bytes (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  // The thread's core is busy, this is only an estimate
+  if (priv->render_thread)
+    return fittsmenu_core_get_sprite_bytes (priv->render_core);
+  return fittsmenu_core_get_sprite_bytes (priv->core);
+}
+
+/* Draw a sprite at a time while idle, until the cache is full */
+static gboolean
+fittsmenu_prerender (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (priv->popped_up && fittsmenu_core_prerender (priv->core))
+    return TRUE;
+  
+  priv->prerender_id = 0;
+  return FALSE;
+}
+
+/* Direction the pointer was travelling when the menu opened, in degrees
+ * clockwise from up */
+void
+fittsmenu_set_approach_angle (Fittsmenu *fittsmenu, gdouble degrees)
+{
+  fittsmenu_core_set_approach_angle (FITTSMENU_GET_PRIVATE (fittsmenu)->core, degrees);
+}
+
+/* Draw an embedded menu centred on x, y of the host's cairo context. Nothing
+ * is drawn unless the menu is popped up. */
+void
+fittsmenu_render (Fittsmenu *fittsmenu, cairo_t *cr, gdouble x, gdouble y)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint radius;
+  
+  g_return_if_fail (priv->embedded);
+  
+  priv->embed_x = x;
+  priv->embed_y = y;
+  
+  if (!priv->popped_up)
+    return;
+  
+  radius = fittsmenu_core_get_menu_radius (priv->core);
+  cairo_save(cr);
+  cairo_translate(cr, x - radius, y - radius);
+  fittsmenu_core_render(priv->core, cr);
+  cairo_restore(cr);
+}
+
+/* Feed host pointer events to an embedded menu, x and y are in the same
+ * co-ordinates as given to fittsmenu_render. Returns TRUE when handled. */
+gboolean
+fittsmenu_inject_motion (Fittsmenu *fittsmenu, gdouble x, gdouble y)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint radius;
+  
+  if (!priv->embedded || !priv->popped_up)
+    return FALSE;
+  
+  radius = fittsmenu_core_get_menu_radius (priv->core);
+  return fittsmenu_pointer_moved (fittsmenu, 
+                                  x - priv->embed_x + radius,
+                                  y - priv->embed_y + radius);
+}
+
+gboolean
+fittsmenu_inject_button_release (Fittsmenu *fittsmenu, guint button)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (!priv->embedded || !priv->popped_up)
+    return FALSE;
+  
+  if (button == 1)
+    fittsmenu_activate_hover(fittsmenu);
+  
+  return TRUE;
+}
+
+/* Scroll an embedded or data source menu, delta is in slices */
+gboolean
+fittsmenu_inject_scroll (Fittsmenu *fittsmenu, gint delta)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (!priv->popped_up)
+    return FALSE;
+  
+  if (fittsmenu_core_scroll (priv->core, delta))
+    fittsmenu_queue_redraw (fittsmenu);
+  return TRUE;
+}
+
+/* Back the menu with n_items produced on demand by func, showing n_visible
+ * of them at a time. See fittsmenu_core_set_source(). */
+void
+fittsmenu_set_source (Fittsmenu *fittsmenu, guint n_items, guint n_visible,
+                      FittsmenuSliceFunc func, gpointer user_data,
+                      GDestroyNotify notify)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  fittsmenu_core_set_source (priv->core, n_items, n_visible, func, user_data, notify);
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+void
+fittsmenu_source_changed (Fittsmenu *fittsmenu, guint n_items)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  fittsmenu_core_source_changed (priv->core, n_items);
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+/* Replace the menu contents, callable from any thread. The menu picks the
+ * snapshot up on its next frame, the main loop is woken to draw one. */
+void
+fittsmenu_publish (Fittsmenu *fittsmenu, FittsmenuSnapshot *snapshot)
+{
+  fittsmenu_core_publish (FITTSMENU_GET_PRIVATE (fittsmenu)->core, snapshot);
+}
+
+/* Contents arrived, from fittsmenu_publish() or a model, on any thread */
+static void
+fittsmenu_published (FittsmenuCore *core, gpointer data)
 {
+  Fittsmenu *fittsmenu = FITTSMENU (data);
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
   
-  priv->animation = value;
+  // One wakeup covers every snapshot published before it runs
+  if (!g_atomic_int_compare_and_exchange (&priv->publish_queued, FALSE, TRUE))
+    return;
+#if FITTSMENU_USE_GTK3
+  g_idle_add (fittsmenu_publish_idle, g_object_ref (fittsmenu));
+#else
+  gdk_threads_add_idle (fittsmenu_publish_idle, g_object_ref (fittsmenu));
+#endif
 }
 
-gint
-fittsmenu_get_animation         (Fittsmenu *fittsmenu)
+static gboolean
+fittsmenu_publish_idle (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  g_atomic_int_set (&priv->publish_queued, FALSE);
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+  
+  g_object_unref (fittsmenu);
+  return FALSE;
+}
+
+/* A slice changed in place, on any thread, it may not even be one of ours */
+static void
+fittsmenu_damaged (FittsmenuCore *core, gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (!g_atomic_int_compare_and_exchange (&priv->damage_queued, FALSE, TRUE))
+    return;
+#if FITTSMENU_USE_GTK3
+  g_idle_add (fittsmenu_damage_idle, g_object_ref (fittsmenu));
+#else
+  gdk_threads_add_idle (fittsmenu_damage_idle, g_object_ref (fittsmenu));
+#endif
+}
+
+/* Redraw the changed sectors alone. The host and the render thread draw
+ * whole frames, they get one. */
+static gboolean
+fittsmenu_damage_idle (gpointer data)
 {
-  return FITTSMENU_GET_PRIVATE (fittsmenu)->animation;  
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gint x, y, width, height;
+  
+  g_atomic_int_set (&priv->damage_queued, FALSE);
+  // Taken even when hidden, the next popup draws everything anyway
+  if (fittsmenu_core_take_damage (priv->core, &x, &y, &width, &height)
+      && priv->popped_up) {
+    if (priv->embedded || priv->render_thread)
+      fittsmenu_queue_redraw (fittsmenu);
+    else
+      gtk_widget_queue_draw_area (GTK_WIDGET (fittsmenu), x, y, width, height);
+  }
+  
+  g_object_unref (fittsmenu);
+  return FALSE;
 }
 
+/* Previews are made by func on a worker thread, requests already running
+ * keep the old func and user_data until they finish */
 void
-fittsmenu_set_menu_radius       (Fittsmenu *fittsmenu, gint value)
+fittsmenu_set_preview_func (Fittsmenu *fittsmenu, FittsmenuPreviewFunc func,
+                            gpointer user_data, GDestroyNotify notify)
 {
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
-	gint x, y;
-  GdkDisplay *display;
-  GdkScreen  *screen;
+  FittsmenuPreviewer *previewer = NULL;
   
-  x = priv->window_x + priv->menu_radius;
-  y = priv->window_y + priv->menu_radius;
+  if (func) {
+    previewer = g_slice_new (FittsmenuPreviewer);
+    previewer->ref_count = 1;
+    previewer->func = func;
+    previewer->user_data = user_data;
+    previewer->notify = notify;
+  }
   
-  priv->menu_radius = value;
-	priv->window_size = value * 2;
-	
-  priv->window_x = x - priv->menu_radius;
-  priv->window_y = y - priv->menu_radius;
+  fittsmenu_preview_cancel (fittsmenu);
+  preview_cache_clear (priv);
+  if (priv->previewer)
+    previewer_unref (priv->previewer);
+  priv->previewer = previewer;
+  fittsmenu_preview_show (fittsmenu, NULL);
+  fittsmenu_preview_hover (fittsmenu);
+}
 
-  gtk_window_resize(GTK_WINDOW(fittsmenu->toplevel), priv->window_size, priv->window_size);
-  gtk_window_move(GTK_WINDOW(fittsmenu->toplevel), priv->window_x, priv->window_y);
+/* Follow the hover with previews. Nothing is asked for until the pointer
+ * rests, so sweeping across the ring costs no preview work at all. */
+static void
+fittsmenu_preview_hover (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  fittsmenu_slice *slice = NULL;
+  cairo_surface_t *cached = NULL;
+  
+  if (priv->previewer && priv->popped_up)
+    slice = fittsmenu_core_pick (priv->core);
+  if (slice == priv->preview_slice)
+    return;
+  
+  fittsmenu_preview_cancel (fittsmenu);
+  if (slice) {
+    priv->preview_slice = fittsmenu_slice_ref (slice);
+    cached = preview_cache_lookup (priv, slice, fittsmenu_core_get_preview_size (priv->core));
+  }
+  fittsmenu_preview_show (fittsmenu, cached);
+  
+  if (slice && !cached)
+    priv->preview_id = g_timeout_add (priv->preview_delay, fittsmenu_preview_start, fittsmenu);
 }
 
-gint
-fittsmenu_get_menu_radius       (Fittsmenu *fittsmenu)
+/* Forget the slice waiting for a preview and cancel its request */
+static void
+fittsmenu_preview_cancel (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (priv->preview_id)
+    g_source_remove (priv->preview_id);
+  priv->preview_id = 0;
+  
+  if (priv->preview_cancellable) {
+    g_cancellable_cancel (priv->preview_cancellable);
+    g_object_unref (priv->preview_cancellable);
+  }
+  priv->preview_cancellable = NULL;
+  
+  if (priv->preview_slice)
+    fittsmenu_slice_unref (priv->preview_slice);
+  priv->preview_slice = NULL;
+}
+
+/* Put surface, or nothing, in the centre of the ring */
+static void
+fittsmenu_preview_show (Fittsmenu *fittsmenu, cairo_surface_t *surface)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  
+  if (surface == priv->preview)
+    return;
+  
+  if (priv->preview)
+    cairo_surface_destroy (priv->preview);
+  priv->preview = surface ? cairo_surface_reference (surface) : NULL;
+  
+  fittsmenu_core_set_preview (priv->core, surface);
+  fittsmenu_forward_settings (fittsmenu, RENDER_PREVIEW);
+  // A shaped window needs a hole in the middle filling to show it
+  if (fittsmenu->toplevel)
+    fittsmenu_update_shape (fittsmenu);
+  if (priv->popped_up)
+    fittsmenu_queue_redraw (fittsmenu);
+}
+
+/* The pointer rested long enough, ask for the preview */
+static gboolean
+fittsmenu_preview_start (gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (data);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  FittsmenuPreviewRequest *request;
+  GTask *task;
+  
+  priv->preview_id = 0;
+  
+  request = g_slice_new (FittsmenuPreviewRequest);
+  request->previewer = previewer_ref (priv->previewer);
+  request->slice = fittsmenu_slice_ref (priv->preview_slice);
+  request->size = fittsmenu_core_get_preview_size (priv->core);
+  
+  priv->preview_cancellable = g_cancellable_new ();
+  task = g_task_new (fittsmenu, priv->preview_cancellable, fittsmenu_preview_done, NULL);
+  g_task_set_task_data (task, request, preview_request_free);
+  g_task_run_in_thread (task, fittsmenu_preview_thread);
+  g_object_unref (task);
+  return FALSE;
+}
+
+static void
+fittsmenu_preview_thread (GTask *task, gpointer source, gpointer task_data,
+                          GCancellable *cancellable)
+{
+  FittsmenuPreviewRequest *request = task_data;
+  cairo_surface_t *surface;
+  
+  surface = request->previewer->func (request->slice, request->size, cancellable,
+                                      request->previewer->user_data);
+  if (g_task_return_error_if_cancelled (task)) {
+    if (surface)
+      cairo_surface_destroy (surface);
+    return;
+  }
+  g_task_return_pointer (task, surface, (GDestroyNotify) cairo_surface_destroy);
+}
+
+/* Back on the main loop. Finished previews are kept even when the pointer
+ * has moved on, it may well come back. */
+static void
+fittsmenu_preview_done (GObject *source, GAsyncResult *result, gpointer data)
+{
+  Fittsmenu *fittsmenu = FITTSMENU (source);
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  FittsmenuPreviewRequest *request;
+  cairo_surface_t *surface;
+  
+  request = g_task_get_task_data (G_TASK (result));
+  if (g_task_get_cancellable (G_TASK (result)) == priv->preview_cancellable) {
+    g_object_unref (priv->preview_cancellable);
+    priv->preview_cancellable = NULL;
+  }
+  
+  // Only ever fails by being cancelled
+  surface = g_task_propagate_pointer (G_TASK (result), NULL);
+  if (!surface)
+    return;
+  
+  if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+    g_printerr ("Fittsmenu: previews must be image surfaces\n");
+  } else if (!priv->dispose_has_run) {
+    preview_cache_insert (priv, request->slice, request->size, surface);
+    if (request->slice == priv->preview_slice)
+      fittsmenu_preview_show (fittsmenu, surface);
+  }
+  cairo_surface_destroy (surface);
+}
+
+static FittsmenuPreviewer*
+previewer_ref (FittsmenuPreviewer *previewer)
+{
+  g_atomic_int_inc (&previewer->ref_count);
+  return previewer;
+}
+
+static void
+previewer_unref (FittsmenuPreviewer *previewer)
+{
+  if (!g_atomic_int_dec_and_test (&previewer->ref_count))
+    return;
+  if (previewer->notify)
+    previewer->notify (previewer->user_data);
+  g_slice_free (FittsmenuPreviewer, previewer);
+}
+
+static void
+preview_request_free (gpointer data)
+{
+  FittsmenuPreviewRequest *request = data;
+  
+  previewer_unref (request->previewer);
+  fittsmenu_slice_unref (request->slice);
+  g_slice_free (FittsmenuPreviewRequest, request);
+}
+
+/* A cached preview of slice at size, marked as most recently used */
+static cairo_surface_t*
+preview_cache_lookup (FittsmenuPrivate *priv, fittsmenu_slice *slice, gint size)
+{
+  FittsmenuPreview *preview;
+  GList *link;
+  
+  for (link = priv->preview_cache->head; link; link = link->next) {
+    preview = link->data;
+    if (preview->slice != slice || preview->size != size)
+      continue;
+    g_queue_unlink (priv->preview_cache, link);
+    g_queue_push_head_link (priv->preview_cache, link);
+    return preview->surface;
+  }
+  return NULL;
+}
+
+/* Keep a finished preview, replacing any older one of the slice and
+ * dropping the least recently used beyond FITTSMENU_PREVIEW_CACHE */
+static void
+preview_cache_insert (FittsmenuPrivate *priv, fittsmenu_slice *slice, gint size,
+                      cairo_surface_t *surface)
+{
+  FittsmenuPreview *preview;
+  GList *link, *next;
+  
+  for (link = priv->preview_cache->head; link; link = next) {
+    next = link->next;
+    preview = link->data;
+    if (preview->slice != slice)
+      continue;
+    g_queue_delete_link (priv->preview_cache, link);
+    fittsmenu_slice_unref (preview->slice);
+    cairo_surface_destroy (preview->surface);
+    g_slice_free (FittsmenuPreview, preview);
+  }
+  
+  preview = g_slice_new (FittsmenuPreview);
+  preview->slice = fittsmenu_slice_ref (slice);
+  preview->size = size;
+  preview->surface = cairo_surface_reference (surface);
+  g_queue_push_head (priv->preview_cache, preview);
+  
+  while (g_queue_get_length (priv->preview_cache) > FITTSMENU_PREVIEW_CACHE) {
+    preview = g_queue_pop_tail (priv->preview_cache);
+    fittsmenu_slice_unref (preview->slice);
+    cairo_surface_destroy (preview->surface);
+    g_slice_free (FittsmenuPreview, preview);
+  }
+}
+
+static void
+preview_cache_clear (FittsmenuPrivate *priv)
 {
-  return FITTSMENU_GET_PRIVATE (fittsmenu)->menu_radius;  
+  FittsmenuPreview *preview;
+  
+  while ((preview = g_queue_pop_head (priv->preview_cache))) {
+    fittsmenu_slice_unref (preview->slice);
+    cairo_surface_destroy (preview->surface);
+    g_slice_free (FittsmenuPreview, preview);
+  }
 }
 
+/* Show the slices of a shared model, see fittsmenu_model_new(). Views are
+ * cheap, hundreds may share one model. */
 void
-fittsmenu_set_menu_inner_radius (Fittsmenu *fittsmenu, gint value)
+fittsmenu_set_model (Fittsmenu *fittsmenu, FittsmenuModel *model)
 {
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
   
-  priv->menu_inner_radius = value;
+  fittsmenu_core_set_model (priv->core, model);
 }
 
-gint
-fittsmenu_get_menu_inner_radius (Fittsmenu *fittsmenu)
+FittsmenuModel*
+fittsmenu_get_model (Fittsmenu *fittsmenu)
 {
-  return FITTSMENU_GET_PRIVATE (fittsmenu)->menu_inner_radius;  
+  return fittsmenu_core_get_model (FITTSMENU_GET_PRIVATE (fittsmenu)->core);
 }
 
 fittsmenu_slice*
 fittsmenu_get_active (Fittsmenu *fittsmenu)
 {
-  return FITTSMENU_GET_PRIVATE (fittsmenu)->active;
+  return fittsmenu_core_get_active (FITTSMENU_GET_PRIVATE (fittsmenu)->core);
+}
+
+/* See fittsmenu_core_get_index() */
+gint
+fittsmenu_get_index (Fittsmenu *fittsmenu, fittsmenu_slice *slice)
+{
+  return fittsmenu_core_get_index (FITTSMENU_GET_PRIVATE (fittsmenu)->core, slice);
 }
 
 void
@@ -912,29 +2870,26 @@ fittsmenu_set_active (Fittsmenu *fittsmenu,
                       guint      index,
                       fittsmenu_slice *slice)
 {
-  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
-  if (index)
-  	priv->active = g_list_nth_data(priv->slices, index);
-	if (slice)
-		priv->active = slice;
+  fittsmenu_core_set_active (FITTSMENU_GET_PRIVATE (fittsmenu)->core, index, slice);
 }
 
-fittsmenu_slice* 
-fittsmenu_slice_new (const char* label, const char* icon) {
-	fittsmenu_slice *slice;
-	slice = g_slice_new(fittsmenu_slice);
-	slice->icon = g_strdup(icon);
-	slice->label = g_strdup(label);
-  return slice;
+gsize
+fittsmenu_get_raster_bytes (Fittsmenu *fittsmenu)
+{
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  gsize bytes;
+  
+  // With a render thread most rasters are drawn, and charged, by its core
+  bytes = fittsmenu_core_get_raster_bytes (priv->core);
+  if (priv->render_core)
+    bytes += fittsmenu_core_get_raster_bytes (priv->render_core);
+  return bytes;
 }
 
-void
-fittsmenu_slice_free (fittsmenu_slice *slice) {
-	g_free(slice->icon);
-  g_free(slice->label);
-  cairo_surface_destroy(slice->icon_buffer);
-  rsvg_handle_free(slice->icon_handle); 
-  g_slice_free(fittsmenu_slice, slice);
+FittsmenuCore*
+fittsmenu_get_core (Fittsmenu *fittsmenu)
+{
+  return FITTSMENU_GET_PRIVATE (fittsmenu)->core;
 }
 
 static void 
@@ -945,15 +2900,23 @@ fittsmenu_dispose (GObject *obj) {
   if (priv->dispose_has_run)
   	return;
   
-  priv->active = NULL;
+  fittsmenu_stop_animation(fittsmenu);
+  fittsmenu_stop_render_thread(fittsmenu);
+  if (priv->prerender_id)
+    g_source_remove (priv->prerender_id);
+  priv->prerender_id = 0;
+  fittsmenu_mark_ungrab(fittsmenu);
+  if (priv->mark_grab)
+    gtk_widget_destroy (priv->mark_grab);
+  priv->mark_grab = NULL;
+  fittsmenu_stop_transition(fittsmenu);
+  fittsmenu_preview_cancel(fittsmenu);
   
-  fittsmenu_slice *slice;
-  GList *list;
-  for (list = priv->slices;list;list = list->next) {
-  	slice = (fittsmenu_slice *)list->data;
-  	fittsmenu_slice_free(slice);
-  }  
-  g_list_free(list);
+  // Publishers and slice changes on other threads may outlive us, once
+  // these return none of them reaches the widget
+  fittsmenu_core_set_model(priv->core, NULL);
+  fittsmenu_core_set_publish_notify(priv->core, NULL, NULL);
+  fittsmenu_core_set_damage_notify(priv->core, NULL, NULL);
   
   priv->dispose_has_run = TRUE;
   
@@ -966,7 +2929,15 @@ fittsmenu_finalize (GObject *obj) {
 	Fittsmenu *fittsmenu = FITTSMENU (obj);
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
   
-  //g_free(priv);
+  // Frees the slices along with everything rendered for them
+  fittsmenu_core_free(priv->core);
+  g_free(priv->rings);
+  preview_cache_clear(priv);
+  g_queue_free(priv->preview_cache);
+  if (priv->preview)
+    cairo_surface_destroy(priv->preview);
+  if (priv->previewer)
+    previewer_unref(priv->previewer);
   
   G_OBJECT_CLASS (fittsmenu_parent_class)->finalize (obj);
 }
@@ -977,14 +2948,89 @@ static void
 set_alpha(GtkWidget *widget)
 {
   GdkScreen* screen = gtk_widget_get_screen (widget);
+#if FITTSMENU_USE_GTK3
+  GdkVisual* visual = gdk_screen_get_rgba_visual (screen);
+
+  if (!visual)
+    visual = gdk_screen_get_system_visual (screen);
+
+  gtk_widget_set_visual (widget, visual);
+#else
   GdkColormap* colormap = gdk_screen_get_rgba_colormap (screen);
 
   if (!colormap)
     colormap = gdk_screen_get_rgb_colormap (screen);
 
   gtk_widget_set_colormap (widget, colormap);
+#endif
+}
+
+/* Whether the default display is across the network, an X display named
+ * with a host like ssh's localhost:10.0 rather than a local :0 */
+static gboolean
+display_is_remote (void)
+{
+  GdkDisplay *display;
+  const gchar *name, *colon;
+  
+  display = gdk_display_get_default ();
+  if (!display)
+    return FALSE;
+  
+  name = gdk_display_get_name (display);
+  colon = name ? strrchr (name, ':') : NULL;
+  if (!colon || colon == name || name[0] == '/')
+    return FALSE;
+  return strncmp (name, "unix:", 5) != 0;
+}
+
+/* Themed icon shown for slices whose icon fails to load, looked up once */
+static const gchar *
+missing_icon_path (void)
+{
+  static gchar *path = NULL;
+  GtkIconInfo *icon_info; 
+  
+  if (path)
+    return path;
+  
+  icon_info = gtk_icon_theme_lookup_icon (gtk_icon_theme_get_default (),
+                                          "image-missing", 1000, 
+                                          GTK_ICON_LOOKUP_FORCE_SVG);
+  if (!icon_info)
+    return NULL;
+  
+  path = g_strdup(gtk_icon_info_get_filename (icon_info));
+#if FITTSMENU_USE_GTK3
+  g_object_unref(icon_info);
+#else
+  gtk_icon_info_free(icon_info);
+#endif
+  return path;
+}
+
+/* Where the pointer is on its screen, and which buttons are held */
+static void
+get_pointer_state (gint *x, gint *y, GdkModifierType *mask)
+{
+  GdkDisplay *display;
+  GdkScreen  *screen;
+#if FITTSMENU_USE_GTK3
+  GdkDevice  *pointer;
+  
+  display = gdk_display_get_default();
+  pointer = gdk_seat_get_pointer (gdk_display_get_default_seat (display));
+  gdk_device_get_position (pointer, &screen, x, y);
+  if (mask)
+    gdk_window_get_device_position (gdk_screen_get_root_window (screen), pointer,
+                                    NULL, NULL, mask);
+#else
+  display = gdk_display_get_default();
+  gdk_display_get_pointer (display, &screen, x, y, mask);
+#endif
 }
 
+#if !FITTSMENU_USE_GTK3
 /* Glitzy cairo create */
 static cairo_t *
 my_cairo_create (GdkWindow* window, Fittsmenu *fittsmenu) 
@@ -1023,6 +3069,7 @@ my_cairo_create (GdkWindow* window, Fittsmenu *fittsmenu)
 #endif //USE_GLITZ
     return gdk_cairo_create (window);
 }
+#endif
 
 /* set rendering-"fidelity" and clear canvas */
 static void
@@ -1034,275 +3081,115 @@ canvas_reset (cairo_t* cr)
   cairo_paint (cr);
 }
 
-/* Double buffer glitz surface */
-// FIXME Need to pass the widget
-#ifdef USE_GLITZ
+/* Prepare a frame of the popup window, a shaped window is only painted
+ * inside its shape and needs no clearing as the slices cover all of it */
 static void
-swap_buffers(Fittsmenu *fittsmenu)
+canvas_begin (Fittsmenu *fittsmenu, cairo_t *cr)
 {
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
-  if (priv->glitz_drawable_format && priv->glitz_drawable_format->doublebuffer)
-    glitz_drawable_swap_buffers (priv->glitz_drawable);
+  
+  if (!priv->shaped) {
+    canvas_reset(cr);
+    return;
+  }
+  
+  cairo_set_tolerance (cr, 0.1);
+  fittsmenu_core_ring_path (priv->core, cr);
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
+  cairo_clip (cr);
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_WINDING);
 }
-#endif //USE_GLITZ
-
 
+/* Shape the popup window to the ring when there is no compositor to blend
+ * it with what is behind. The mask is only rebuilt when the radii or the
+ * preview's size change. */
 static void
-render(cairo_t* cr, Fittsmenu *fittsmenu) 
+fittsmenu_update_shape (Fittsmenu *fittsmenu)
 {
   FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
-  gint no_of_slices = g_list_length(priv->slices);
+  gboolean shaped;
+  gint radius, inner_radius, preview_width, preview_height;
+  cairo_t *cr;
+#if FITTSMENU_USE_GTK3
+  cairo_surface_t *surface;
+  cairo_region_t *region;
+#else
+  GdkBitmap *mask;
+#endif
   
-  cairo_matrix_t matrix;
-  gdouble arc_start, arc_end, arc_radius, arc_scale;
-  gint arc_width, arc_sdeg, arc_edeg;
-  gint cx, cy, i;
-  fittsmenu_slice *slice;
-  fittsmenu_slice *hover;
-  gdouble px, py, ex, ey;
-  gdouble icon_cangle, icon_cdist;
-  gdouble icon_scale, this_icon_scale;
-  gdouble icon_cx, icon_cy;
-  gint icon_offset_x, icon_offset_y;
-  gint icon_width, icon_height;
-  cairo_surface_t *cr_surface;
-  cairo_t *cr_buf;
-  gdouble mouse_angle, icon_angle, distance;
-  RsvgDimensionData icon_size = { 0, 0, 0.0, 0.0 };
-  GtkIconInfo *icon_info; 
-  gchar *icon_cmp;
-  GError *iconerror = NULL;
+  shaped = !gdk_screen_is_composited (gtk_widget_get_screen (fittsmenu->toplevel));
+  radius = fittsmenu_core_get_menu_radius (priv->core);
+  inner_radius = fittsmenu_core_get_menu_inner_radius (priv->core);
+  // The preview is cut into the middle of the shape
+  preview_width = priv->preview ? cairo_image_surface_get_width (priv->preview) : 0;
+  preview_height = priv->preview ? cairo_image_surface_get_height (priv->preview) : 0;
   
-  // Calculate the arc of a slice in radians and its width
-  arc_radius = (2*G_PI) / no_of_slices;
-  arc_scale = arc_radius / ((2*G_PI) / 13);
-  arc_width = priv->menu_radius - priv->menu_inner_radius;
+  if (shaped == priv->shaped
+      && (!shaped || (radius == priv->shape_radius && inner_radius == priv->shape_inner_radius
+                      && preview_width == priv->shape_preview_width
+                      && preview_height == priv->shape_preview_height)))
+    return;
   
-  arc_start = priv->menu_angle * (G_PI / 180.0f);
-  arc_end = arc_start + arc_radius;
+  priv->shaped = shaped;
+  priv->shape_radius = radius;
+  priv->shape_inner_radius = inner_radius;
+  priv->shape_preview_width = preview_width;
+  priv->shape_preview_height = preview_height;
+  gtk_widget_queue_draw (GTK_WIDGET (fittsmenu));
   
-  // Set the centre co-ordinates 
-  cx = priv->menu_radius;
-  cy = priv->menu_radius;
+  if (!shaped) {
+#if FITTSMENU_USE_GTK3
+    gtk_widget_shape_combine_region (fittsmenu->toplevel, NULL);
+    gtk_widget_input_shape_combine_region (fittsmenu->toplevel, NULL);
+#else
+    gtk_widget_shape_combine_mask (fittsmenu->toplevel, NULL, 0, 0);
+    gtk_widget_input_shape_combine_mask (fittsmenu->toplevel, NULL, 0, 0);
+#endif
+    return;
+  }
   
-  cairo_save(cr);
+#if FITTSMENU_USE_GTK3
+  surface = cairo_image_surface_create (CAIRO_FORMAT_A1, priv->window_size, priv->window_size);
+  cr = cairo_create (surface);
+  fittsmenu_core_ring_path (priv->core, cr);
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
+  cairo_fill (cr);
+  cairo_destroy (cr);
   
-  // Draw the centre of the menu
-  cairo_arc (cr, cx, cy, priv->menu_inner_radius- 10, 0., 2*G_PI);
-  cairo_set_source_rgba(cr, 0, 0, 0, .65);
-  cairo_fill(cr);
-  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);      
+  region = gdk_cairo_region_create_from_surface (surface);
+  gtk_widget_shape_combine_region (fittsmenu->toplevel, region);
+  gtk_widget_input_shape_combine_region (fittsmenu->toplevel, region);
+  cairo_region_destroy (region);
+  cairo_surface_destroy (surface);
+#else
+  mask = (GdkBitmap *) gdk_pixmap_new (NULL, priv->window_size, priv->window_size, 1);
+  cr = gdk_cairo_create (mask);
+  // New bitmaps hold garbage
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+  fittsmenu_core_ring_path (priv->core, cr);
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
+  cairo_fill (cr);
+  cairo_destroy (cr);
   
-  hover = NULL;
-  for (i = 0;i < no_of_slices;i++) {
-    slice = g_list_nth_data(priv->slices, i);
-
-    // Calculate and draw the slice
-    polrec(priv->menu_radius - arc_width,  arc_end + (G_PI/2), &py, &px);
-    ex = px+cx;
-    ey = (py * -1)+cy;// Icon width should always be 48 for svgs now
-    
-    cairo_arc(cr, cx, cy, priv->menu_radius - 3, arc_start, arc_end);
-    cairo_line_to(cr, ex, ey);
-    
-    polrec(priv->menu_radius - 3, arc_start + (G_PI/2), &py, &px);
-    ex = px+cx;
-    ey = (py * -1)+cy;
-    
-    cairo_arc_negative(cr, cx, cy, priv->menu_radius - arc_width - 10, arc_end, arc_start); 
-    cairo_line_to(cr, ex, ey);
-    
-    // Limit mouse angles to 360 degrees
-    priv->mouse_angle = (int)priv->mouse_angle % 360;
-
-    // Convert angles of the segment arcs to degrees 
-    arc_sdeg = (arc_start * (180/G_PI))+90;
-    arc_edeg = (arc_end * (180/G_PI))+90;
-        
-    // Limit arc degrees to 360 
-    arc_sdeg = arc_sdeg % 360;
-    arc_edeg = arc_edeg % 360;
-        
-    // Special cases for passing through 0 degrees
-    if ((priv->mouse_angle < arc_sdeg) && (arc_sdeg > arc_edeg))
-      arc_sdeg = arc_sdeg - 360;
-    else if (arc_sdeg > arc_edeg)
-      arc_edeg = arc_edeg + 360;
-
-    // Fill and stroke each segment 
-    if ((priv->mouse_angle > arc_sdeg) && (priv->mouse_angle < arc_edeg) 
-        && (priv->menu_over == TRUE)) {
-      cairo_set_source_rgba(cr, .3, .3, .3, .5);
-      hover = slice;
-    } else {
-      cairo_set_source_rgba(cr, 0, 0, 0, .7);
-    }
-    
-    cairo_fill_preserve(cr);
-    cairo_set_source_rgba(cr, .0, .0, .0, .1);
-    cairo_set_line_width(cr, 3);
-    cairo_stroke(cr);
-    
-    icon_cmp = g_strdup(slice->icon);
-    icon_cmp = g_ascii_strdown(icon_cmp, strlen(icon_cmp));
-    icon_cmp = g_strreverse(icon_cmp);
-    
-    if (!g_ascii_strncasecmp("gvs", icon_cmp, 3)) {
-      // Repeatedly complains the error isn't null? go figure!
-      slice->icon_handle = rsvg_handle_new_from_file (slice->icon, &iconerror);
-      if (iconerror != NULL) {
-        g_printerr("RSVG: %s %s\n", iconerror->message, slice->icon);
-        g_clear_error(&iconerror);
-          
-    		// Load the default missing icon instead
-    		icon_info = gtk_icon_theme_lookup_icon (gtk_icon_theme_get_default (),
-        	                                      "image-missing", 1000, 
-         	                                      GTK_ICON_LOOKUP_FORCE_SVG);
-          
-        slice->icon = g_strdup(gtk_icon_info_get_filename (icon_info));
-        slice->icon_handle = rsvg_handle_new_from_file (slice->icon, &iconerror);
-          
-        if (iconerror != NULL) {
-        	g_printerr("RSVG: %s\n", iconerror->message);
-          	
-         	if (iconerror != NULL)
-         		g_error_free(iconerror);
-          	
-         	return;
-        }
-      }
-      
-     	if (iconerror != NULL)
-        g_error_free(iconerror);	
-      else
-        rsvg_handle_get_dimensions(slice->icon_handle, &icon_size);
-      
-      // Icon width/height should always be 48 for svgs now, specified on surface load
-      icon_width = icon_size.width;
-      icon_height = icon_size.height;
-    } else {
-      // We need to get image sizes for png files still lets assume
-      // 48x48 for now
-      icon_width = 48;
-      icon_height = 48;
-    }
-    
-    // Calculate the size/position of the current icon 
-    if (icon_size.width >= icon_size.height)
-    	icon_scale = (gdouble)32 / (gdouble)icon_size.width;
-    else
-    	icon_scale = (gdouble)32 / (gdouble)icon_size.height;
-    
-    icon_cangle = arc_start + (arc_radius / 2);
-    
-    if ((priv->menu_over) && (priv->animation == FITTSMENU_ANIM_ISCALE)) {
-      /* Scaled icons */
-      icon_angle  = icon_cangle * (180/G_PI);
-      icon_angle  = ((int)icon_angle+90) % 360;
-      mouse_angle = priv->mouse_angle;
-      distance    = (icon_angle - mouse_angle);
-      distance    = distance*distance;
-      distance    = sqrt(distance);
-      
-      if (distance > 180)
-        distance  = (distance * -1)+360;
-      
-      //g_print("%d %d %s\n", (int)mouse_angle, (int)icon_angle, slice->label);
-      //g_print("Distance to %s = %d\n", slice->label, (int)distance);
-      //this_icon_scale = cosf( distance * (G_PI / 180.0f ));
-      //g_print("Icon scale %s %f\n", slice->label,this_icon_scale);
-      //this_icon_scale = icon_scale * arc_scale * this_icon_scale;      
-    } else {
-      this_icon_scale = 0;
-    }
-    
-    icon_scale = icon_scale * arc_scale;
-    
-    icon_width  = icon_width * icon_scale;
-    icon_height = icon_height * icon_scale;
-    
-    icon_offset_x = icon_width / 2;
-    icon_offset_y = icon_height / 2;
-    
-    icon_cdist = priv->menu_radius - (sqrt(icon_width*icon_width + icon_height*icon_height)/2) - 4;
-
-    polrec(icon_cdist, icon_cangle, &icon_cx, &icon_cy);
-    
-    
-    // Render the current icon 
-    cairo_save (cr);
-    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
-    
-    cairo_matrix_init_scale     (&matrix, icon_scale, icon_scale);
-    cairo_transform(cr, &matrix);
-    
-    cairo_matrix_init_translate (&matrix, (icon_cx + cx - icon_offset_x)/icon_scale, 
-                                 (icon_cy + cy - icon_offset_y)/icon_scale);
-    cairo_transform (cr, &matrix);
-
-    if (slice->icon_buffer) {
-      cairo_set_source_surface (cr, slice->icon_buffer, 0.0, 0.0);
-      cairo_paint (cr);
-    } else {
-      /* Fill buffer on first render */
-      // Crypticly svg :)
-      if (!g_ascii_strncasecmp("gvs", icon_cmp, 3)) {
-        /* All of this code looks severely outdated, mostly because cairo has good svg support now :)*/
-        cr_surface = cairo_surface_create_similar (cairo_get_target (cr), 
-                                                   CAIRO_CONTENT_COLOR_ALPHA,
-                                                   priv->window_size, 
-                                                   priv->window_size);
-        cr_buf = cairo_create(cr_surface);
-        rsvg_handle_render_cairo (slice->icon_handle, cr_buf);
-        cairo_destroy(cr_buf);
-        //*/
-        //cr_surface = cairo_svg_surface_create(slice->icon, 48, 48);
-      } else {
-        cr_surface = cairo_image_surface_create_from_png(slice->icon);
-      }
-      slice->icon_buffer = cr_surface;
-      cairo_set_source_surface (cr, slice->icon_buffer, 0.0, 0.0);
-      cairo_paint (cr);   
-      //rsvg_handle_render_cairo (slice->icon_handle, cr);
-    }
-		priv->hover = hover;
-    cairo_restore (cr);
-    
-    arc_start = arc_start + arc_radius;
-    arc_end = arc_start + arc_radius;
-  }
-    
-  cairo_restore(cr);
-}
-
-/* Cartesian co-ordinate conversion*/
-static
-void recpol(gdouble x, gdouble y, gdouble *pr, gdouble *pa)
-{
-  gdouble a;
-
-  if (x == 0.0 && y == 0.0) { /* special case, both components 0 */
-    *pa = 0.0;
-    *pr = 0.0;
-    return;
-  }
-
-  a = atan2(y,x);             /* angle +- pi/2 */
-  if (a < 0.0)
-    a = a + (2 * M_PI);       /* want it to be 0 to 2 pi   */
-  *pa = a;
-/**pr = hypot(x,y);*/         /* radius.  HP bug in hypot. */
-  *pr = sqrt(x*x + y*y);      /* radius */
-  return;
+  gtk_widget_shape_combine_mask (fittsmenu->toplevel, mask, 0, 0);
+  gtk_widget_input_shape_combine_mask (fittsmenu->toplevel, mask, 0, 0);
+  g_object_unref (mask);
+#endif
 }
 
-static 
-void polrec(gdouble r, gdouble a, gdouble *px, gdouble *py)
+/* Double buffer glitz surface */
+// FIXME Need to pass the widget
+#ifdef USE_GLITZ
+static void
+swap_buffers(Fittsmenu *fittsmenu)
 {
-  *px = r*cos(a);
-  *py = r*sin(a);
-  return;
+  FittsmenuPrivate *priv = FITTSMENU_GET_PRIVATE (fittsmenu);
+  if (priv->glitz_drawable_format && priv->glitz_drawable_format->doublebuffer)
+    glitz_drawable_swap_buffers (priv->glitz_drawable);
 }
+#endif //USE_GLITZ
 
 long
 get_time (void)
@@ -2,28 +2,10 @@
 #define __FITTSMENU_H__
 
 #include <glib.h>
+#include <gio/gio.h>
 #include <cairo.h>
-#include <librsvg/rsvg.h>
 
-typedef struct _fittsmenu_slice fittsmenu_slice;
-
-struct _fittsmenu_slice 
-{
-  gchar *label;
-  gchar *icon;
-  gint button;
-  RsvgHandle *icon_handle;
-  cairo_surface_t *icon_buffer;
-  guint index;
-};
-
-enum
-{
-	FITTSMENU_ANIM_NONE,
-	FITTSMENU_ANIM_CROTATE,
-	FITTSMENU_ANIM_ISCALE,
-	FITTSMENU_ANIM_PULSE
-};
+#include "fittsmenu-core.h"
 
 G_BEGIN_DECLS
 
@@ -50,8 +32,16 @@ struct _FittsmenuClass
   void (* ticked)   (Fittsmenu * fittsmenu);
   void (* revolved) (Fittsmenu * fittsmenu);
   void (* clicked)  (Fittsmenu * fittsmenu);
+  void (* redraw)   (Fittsmenu * fittsmenu);
 };
 
+/* Makes a preview of what a slice opens, size pixels across, on a worker
+ * thread. Returns a new image surface or NULL for none, and should give up
+ * early once cancellable is cancelled. */
+typedef cairo_surface_t* (*FittsmenuPreviewFunc) (fittsmenu_slice *slice, gint size,
+                                                  GCancellable *cancellable,
+                                                  gpointer user_data);
+
 GType      fittsmenu_get_type   (void) G_GNUC_CONST;
 Fittsmenu* fittsmenu_new        (void);
 
@@ -62,15 +52,77 @@ void       fittsmenu_set_menu_radius       (Fittsmenu *fittsmenu, gint value);
 gint       fittsmenu_get_menu_radius       (Fittsmenu *fittsmenu);
 void       fittsmenu_set_menu_inner_radius (Fittsmenu *fittsmenu, gint value);
 gint       fittsmenu_get_menu_inner_radius (Fittsmenu *fittsmenu);
+void       fittsmenu_set_embedded          (Fittsmenu *fittsmenu, gboolean value);
+gboolean   fittsmenu_get_embedded          (Fittsmenu *fittsmenu);
+void       fittsmenu_set_usage_id          (Fittsmenu *fittsmenu, const gchar *menu_id);
+const gchar* fittsmenu_get_usage_id        (Fittsmenu *fittsmenu);
+void       fittsmenu_set_approach_angle    (Fittsmenu *fittsmenu, gdouble degrees);
+void       fittsmenu_set_marking           (Fittsmenu *fittsmenu, gboolean value);
+gboolean   fittsmenu_get_marking           (Fittsmenu *fittsmenu);
+void       fittsmenu_set_marking_delay     (Fittsmenu *fittsmenu, gint delay);
+gint       fittsmenu_get_marking_delay     (Fittsmenu *fittsmenu);
+/* Remote is turned on when the menu is made if the X display is named with
+ * a host, as under ssh -X, and a remote menu is never threaded. Turn remote
+ * off before fittsmenu_set_threaded() to thread a menu on such a display. */
+void       fittsmenu_set_remote            (Fittsmenu *fittsmenu, gboolean value);
+gboolean   fittsmenu_get_remote            (Fittsmenu *fittsmenu);
+void       fittsmenu_set_transition_time   (Fittsmenu *fittsmenu, gint msec);
+gint       fittsmenu_get_transition_time   (Fittsmenu *fittsmenu);
+void       fittsmenu_set_threaded          (Fittsmenu *fittsmenu, gboolean value);
+gboolean   fittsmenu_get_threaded          (Fittsmenu *fittsmenu);
+void       fittsmenu_set_sprite_cache      (Fittsmenu *fittsmenu, guint n_angles, gsize max_bytes);
+gsize      fittsmenu_get_sprite_bytes      (Fittsmenu *fittsmenu);
+void       fittsmenu_set_icon_tint         (Fittsmenu *fittsmenu, gint tint,
+                                            gdouble red, gdouble green,
+                                            gdouble blue, gdouble alpha);
+void       fittsmenu_unset_icon_tint       (Fittsmenu *fittsmenu, gint tint);
+void       fittsmenu_set_slice_style       (Fittsmenu *fittsmenu, gint state,
+                                            const FittsmenuSliceStyle *style);
+void       fittsmenu_set_themed            (Fittsmenu *fittsmenu, gboolean value);
+gboolean   fittsmenu_get_themed            (Fittsmenu *fittsmenu);
+void       fittsmenu_set_lod_sizes         (Fittsmenu *fittsmenu, gint icon_min,
+                                            gint glyph_min, gint swatch_min);
+void       fittsmenu_set_rings             (Fittsmenu *fittsmenu, const FittsmenuRing *rings,
+                                            guint n_rings);
+void       fittsmenu_set_preview_delay     (Fittsmenu *fittsmenu, gint msec);
+gint       fittsmenu_get_preview_delay     (Fittsmenu *fittsmenu);
 
 void       fittsmenu_append     (Fittsmenu *fittsmenu, fittsmenu_slice *slice);
 void       fittsmenu_remove     (Fittsmenu *fittsmenu, fittsmenu_slice *slice);
 void       fittsmenu_popup      (Fittsmenu *fittsmenu, guint button);
 void       fittsmenu_popdown    (Fittsmenu *fittsmenu);
 fittsmenu_slice*  fittsmenu_get_active (Fittsmenu *fittsmenu);
+gint       fittsmenu_get_index  (Fittsmenu *fittsmenu, fittsmenu_slice *slice);
 void       fittsmenu_set_active (Fittsmenu *fittsmenu, guint index, fittsmenu_slice *slice);
-fittsmenu_slice*  fittsmenu_slice_new (const char*icon, const char* label);
-void			 fittsmenu_slice_free (fittsmenu_slice *slice);
+/* Swap in new contents from any thread, see fittsmenu_snapshot_new() */
+void       fittsmenu_publish    (Fittsmenu *fittsmenu, FittsmenuSnapshot *snapshot);
+/* Share slices with other menus */
+void            fittsmenu_set_model (Fittsmenu *fittsmenu, FittsmenuModel *model);
+FittsmenuModel* fittsmenu_get_model (Fittsmenu *fittsmenu);
+/* Produce slices on demand, only a window of n_visible is shown and the
+ * wheel or resting on its first or last slice scrolls through the rest */
+void       fittsmenu_set_source     (Fittsmenu *fittsmenu, guint n_items, guint n_visible,
+                                     FittsmenuSliceFunc func, gpointer user_data,
+                                     GDestroyNotify notify);
+void       fittsmenu_source_changed (Fittsmenu *fittsmenu, guint n_items);
+/* Previews of the hovered slice in the centre of the ring, asked for once
+ * the pointer has rested on it for the preview delay and cancelled when it
+ * moves on. The last few are kept. A NULL func turns previews off. */
+void       fittsmenu_set_preview_func (Fittsmenu *fittsmenu, FittsmenuPreviewFunc func,
+                                       gpointer user_data, GDestroyNotify notify);
+
+/* Embedded mode, the host draws the menu into its own surface on
+ * "redraw-signal" and forwards its pointer events */
+void       fittsmenu_render                (Fittsmenu *fittsmenu, cairo_t *cr, gdouble x, gdouble y);
+gboolean   fittsmenu_inject_motion         (Fittsmenu *fittsmenu, gdouble x, gdouble y);
+gboolean   fittsmenu_inject_button_release (Fittsmenu *fittsmenu, guint button);
+gboolean   fittsmenu_inject_scroll         (Fittsmenu *fittsmenu, gint delta);
+
+/* Raster memory held by this menu, see fittsmenu_set_raster_budget() */
+gsize      fittsmenu_get_raster_bytes       (Fittsmenu *fittsmenu);
+
+/* The toolkit independent menu behind the widget */
+FittsmenuCore*  fittsmenu_get_core (Fittsmenu *fittsmenu);
 
 G_END_DECLS
 
@@ -0,0 +1,301 @@
+#ifndef __FITTSMENU_HPP__
+#define __FITTSMENU_HPP__
+
+/* C++17 front end to Fittsmenu, header only.
+ *
+ * Slice and Menu are move only handles owning one reference each, so a
+ * slice appended to a menu and removed again is freed exactly once, by
+ * whichever of the two lets go last. Connection disconnects its handler
+ * when it goes out of scope.
+ *
+ * Menus known at compile time are written as a MenuSpec:
+ *
+ *   static constexpr fittsmenu::MenuSpec<2> tools {{
+ *     { "Pen",    "pen.svg" },
+ *     { "Eraser", "eraser.svg" },
+ *   }};
+ *   menu.set_contents<tools> ();
+ *
+ * Each spec is laid out once in a static slice table and published as a
+ * single snapshot, nothing is allocated per slice. */
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <gtk/gtk.h>
+
+#include "fittsmenu.h"
+
+namespace fittsmenu {
+
+class Slice
+{
+public:
+  Slice () noexcept = default;
+  Slice (const char *label, const char *icon)
+    : slice_ (fittsmenu_slice_new (label, icon)) {}
+  // Takes over the caller's reference
+  explicit Slice (fittsmenu_slice *slice) noexcept : slice_ (slice) {}
+
+  static Slice ref (fittsmenu_slice *slice)
+  {
+    return Slice (slice ? fittsmenu_slice_ref (slice) : nullptr);
+  }
+  static Slice from_bytes (const char *label, GBytes *data)
+  {
+    return Slice (fittsmenu_slice_new_from_bytes (label, data));
+  }
+  static Slice from_pixbuf (const char *label, GdkPixbuf *pixbuf)
+  {
+    return Slice (fittsmenu_slice_new_from_pixbuf (label, pixbuf));
+  }
+  static Slice from_surface (const char *label, cairo_surface_t *surface)
+  {
+    return Slice (fittsmenu_slice_new_from_surface (label, surface));
+  }
+  static Slice from_resource (const char *label, const char *path)
+  {
+    return Slice (fittsmenu_slice_new_from_resource (label, path));
+  }
+
+  Slice (const Slice &) = delete;
+  Slice &operator= (const Slice &) = delete;
+  Slice (Slice &&other) noexcept : slice_ (std::exchange (other.slice_, nullptr)) {}
+  Slice &operator= (Slice &&other) noexcept
+  {
+    if (this != &other) {
+      reset ();
+      slice_ = std::exchange (other.slice_, nullptr);
+    }
+    return *this;
+  }
+  ~Slice () { reset (); }
+
+  fittsmenu_slice *get () const noexcept { return slice_; }
+  // Hands the reference to the caller
+  fittsmenu_slice *release () noexcept { return std::exchange (slice_, nullptr); }
+  explicit operator bool () const noexcept { return slice_ != nullptr; }
+  bool operator== (const Slice &other) const noexcept { return slice_ == other.slice_; }
+  bool operator!= (const Slice &other) const noexcept { return slice_ != other.slice_; }
+
+  const char *label () const noexcept { return slice_->label; }
+  // A copy, set_icon() may be replacing it on another thread
+  std::string icon () const
+  {
+    gchar *icon = fittsmenu_slice_dup_icon (slice_);
+    std::string copy (icon ? icon : "");
+    g_free (icon);
+    return copy;
+  }
+  // Both only before the slice is added to a menu
+  void set_sensitive (bool value) { fittsmenu_slice_set_sensitive (slice_, value); }
+  void set_monochrome (bool value) { fittsmenu_slice_set_monochrome (slice_, value); }
+  // Any time, from any thread
+  void set_badge (const char *badge) { fittsmenu_slice_set_badge (slice_, badge); }
+  void set_progress (double fraction) { fittsmenu_slice_set_progress (slice_, fraction); }
+  void set_icon (const char *icon) { fittsmenu_slice_set_icon (slice_, icon); }
+
+  void reset () noexcept
+  {
+    if (slice_)
+      fittsmenu_slice_unref (std::exchange (slice_, nullptr));
+  }
+
+private:
+  fittsmenu_slice *slice_ = nullptr;
+};
+
+/* A signal handler, disconnected when the connection is dropped unless
+ * the menu has gone first */
+class Connection
+{
+public:
+  Connection () noexcept { g_weak_ref_init (&instance_, nullptr); }
+  Connection (GObject *instance, gulong id) : id_ (id) { g_weak_ref_init (&instance_, instance); }
+
+  Connection (const Connection &) = delete;
+  Connection &operator= (const Connection &) = delete;
+  // Weak references can't be copied bytewise, they are taken over by hand
+  Connection (Connection &&other) noexcept : id_ (std::exchange (other.id_, 0))
+  {
+    gpointer instance = g_weak_ref_get (&other.instance_);
+    g_weak_ref_init (&instance_, instance);
+    g_weak_ref_set (&other.instance_, nullptr);
+    if (instance)
+      g_object_unref (instance);
+  }
+  Connection &operator= (Connection &&other) noexcept
+  {
+    if (this != &other) {
+      disconnect ();
+      gpointer instance = g_weak_ref_get (&other.instance_);
+      g_weak_ref_set (&instance_, instance);
+      g_weak_ref_set (&other.instance_, nullptr);
+      if (instance)
+        g_object_unref (instance);
+      id_ = std::exchange (other.id_, 0);
+    }
+    return *this;
+  }
+  ~Connection ()
+  {
+    disconnect ();
+    g_weak_ref_clear (&instance_);
+  }
+
+  void disconnect () noexcept
+  {
+    gpointer instance = g_weak_ref_get (&instance_);
+    if (instance) {
+      if (id_ && g_signal_handler_is_connected (instance, id_))
+        g_signal_handler_disconnect (instance, id_);
+      g_object_unref (instance);
+    }
+    g_weak_ref_set (&instance_, nullptr);
+    id_ = 0;
+  }
+  // Leave the handler connected for the life of the menu
+  void release () noexcept
+  {
+    g_weak_ref_set (&instance_, nullptr);
+    id_ = 0;
+  }
+
+private:
+  GWeakRef instance_;
+  gulong id_ = 0;
+};
+
+struct SliceSpec
+{
+  const char *label;
+  const char *icon;
+};
+
+/* Labels, icons and their order, in the order they go round the ring */
+template <std::size_t N>
+using MenuSpec = std::array<SliceSpec, N>;
+
+/* The slices of a MenuSpec, laid out once in static storage that lives as
+ * long as the program. The table keeps a reference on each slice so they
+ * are never freed, however many menus show them. */
+template <const auto &Spec>
+class SliceTable
+{
+public:
+  static constexpr std::size_t size () noexcept { return Spec.size (); }
+
+  static SliceTable &instance ()
+  {
+    static SliceTable table;
+    return table;
+  }
+
+  fittsmenu_slice **data () noexcept { return pointers_.data (); }
+
+private:
+  SliceTable ()
+  {
+    for (std::size_t i = 0; i < size (); i++) {
+      fittsmenu_slice_init_static (&slices_[i], Spec[i].label, Spec[i].icon);
+      pointers_[i] = &slices_[i];
+    }
+  }
+
+  std::array<fittsmenu_slice, Spec.size ()> slices_;
+  std::array<fittsmenu_slice *, Spec.size ()> pointers_;
+};
+
+class Menu
+{
+public:
+  Menu () : widget_ (fittsmenu_new ()), created_ (true) { g_object_ref_sink (widget_); }
+  // Takes over the caller's reference, the caller still owns the popup
+  // window
+  explicit Menu (Fittsmenu *widget) noexcept : widget_ (widget) {}
+
+  Menu (const Menu &) = delete;
+  Menu &operator= (const Menu &) = delete;
+  Menu (Menu &&other) noexcept
+    : widget_ (std::exchange (other.widget_, nullptr)),
+      created_ (std::exchange (other.created_, false)) {}
+  Menu &operator= (Menu &&other) noexcept
+  {
+    if (this != &other) {
+      reset ();
+      widget_ = std::exchange (other.widget_, nullptr);
+      created_ = std::exchange (other.created_, false);
+    }
+    return *this;
+  }
+  ~Menu () { reset (); }
+
+  Fittsmenu *get () const noexcept { return widget_; }
+  GtkWidget *widget () const noexcept { return GTK_WIDGET (widget_); }
+
+  // The menu takes a reference of its own, slice stays usable
+  void append (const Slice &slice) { fittsmenu_append (widget_, fittsmenu_slice_ref (slice.get ())); }
+  void append (Slice &&slice) { fittsmenu_append (widget_, slice.release ()); }
+  // Drops the menu's reference only
+  void remove (const Slice &slice) { fittsmenu_remove (widget_, slice.get ()); }
+
+  // Replace the contents with a compile time spec, in one batch
+  template <const auto &Spec>
+  void set_contents ()
+  {
+    SliceTable<Spec> &table = SliceTable<Spec>::instance ();
+    FittsmenuSnapshot *snapshot = fittsmenu_snapshot_new (table.data (), table.size ());
+    fittsmenu_publish (widget_, snapshot);
+    fittsmenu_snapshot_unref (snapshot);
+  }
+
+  void popup (guint button = 0) { fittsmenu_popup (widget_, button); }
+  void popdown () { fittsmenu_popdown (widget_); }
+  Slice active () const { return Slice::ref (fittsmenu_get_active (widget_)); }
+
+  // Handlers take no arguments and are kept until disconnected
+  template <typename F> Connection on_clicked (F &&func) { return connect ("clicked-signal", std::forward<F> (func)); }
+  template <typename F> Connection on_tick (F &&func) { return connect ("tick-signal", std::forward<F> (func)); }
+  template <typename F> Connection on_revolution (F &&func) { return connect ("revolution-signal", std::forward<F> (func)); }
+  template <typename F> Connection on_redraw (F &&func) { return connect ("redraw-signal", std::forward<F> (func)); }
+
+private:
+  template <typename F>
+  Connection connect (const char *signal, F &&func)
+  {
+    using Func = std::decay_t<F>;
+    gulong id = g_signal_connect_data (widget_, signal,
+                                       G_CALLBACK (&Menu::invoke<Func>),
+                                       new Func (std::forward<F> (func)),
+                                       &Menu::destroy<Func>, GConnectFlags (0));
+    return Connection (G_OBJECT (widget_), id);
+  }
+
+  template <typename Func>
+  static void invoke (Fittsmenu *, gpointer data) { (*static_cast<Func *> (data)) (); }
+  template <typename Func>
+  static void destroy (gpointer data, GClosure *) { delete static_cast<Func *> (data); }
+
+  void reset () noexcept
+  {
+    if (!widget_)
+      return;
+    // The popup window holds the widget, it goes with us when we made the
+    // widget, an adopted one's is left to whoever made it
+    if (created_ && widget_->toplevel)
+      gtk_widget_destroy (widget_->toplevel);
+    g_object_unref (std::exchange (widget_, nullptr));
+    created_ = false;
+  }
+
+  Fittsmenu *widget_ = nullptr;
+  // Made by this handle rather than adopted
+  bool created_ = false;
+};
+
+} // namespace fittsmenu
+
+#endif /* __FITTSMENU_HPP__ */
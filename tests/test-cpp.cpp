@@ -0,0 +1,153 @@
+/*******************************************************************************
+ * Fittsmenu C++ front end test
+ *
+ *   Builds fittsmenu.hpp as C++17 and checks the handles do what the header
+ *   says: a MenuSpec is published as one snapshot of the same static slices
+ *   for every menu, clicked handlers go when their connection does, and a
+ *   menu adopted from C leaves its popup window to whoever made it.
+ *
+ *   Needs a display for the widget, and is skipped without one.
+ *
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "fittsmenu.hpp"
+
+/* Exit status automake takes as a skipped test */
+#define EXIT_SKIP 77
+
+static constexpr fittsmenu::MenuSpec<3> tools {{
+  { "Pen",    EXAMPLES_DATA_PATH "icon_freehand.svg" },
+  { "Eraser", EXAMPLES_DATA_PATH "icon_droplet.svg" },
+  { "Text",   EXAMPLES_DATA_PATH "icon_text.svg" },
+}};
+
+static bool check_contents (void);
+static bool check_clicked (void);
+static bool check_adopted (void);
+static bool check (bool ok, const char *what);
+
+int
+main (int argc, char **argv)
+{
+  bool ok;
+
+  if (!gtk_init_check (&argc, &argv)) {
+    g_print ("# no display, skipped\n");
+    return EXIT_SKIP;
+  }
+
+  ok = check_contents ();
+  ok = check_clicked () && ok;
+  ok = check_adopted () && ok;
+
+  return ok ? 0 : 1;
+}
+
+/* Two menus set from the same spec show the same slices, in spec order */
+static bool
+check_contents (void)
+{
+  fittsmenu::Menu pens, erasers;
+  fittsmenu_slice **slices = fittsmenu::SliceTable<tools>::instance ().data ();
+  GList *shown;
+  bool ok = true;
+  std::size_t i;
+
+  pens.set_contents<tools> ();
+  erasers.set_contents<tools> ();
+  // Published contents are taken up at the start of the next frame
+  fittsmenu_core_sync (fittsmenu_get_core (pens.get ()));
+  fittsmenu_core_sync (fittsmenu_get_core (erasers.get ()));
+
+  shown = fittsmenu_core_get_slices (fittsmenu_get_core (pens.get ()));
+  ok = check (g_list_length (shown) == tools.size (), "spec slices shown") && ok;
+  for (i = 0; i < tools.size (); i++) {
+    ok = check (fittsmenu_get_index (pens.get (), slices[i]) == (gint) i,
+                "spec slice in spec order") && ok;
+    ok = check (fittsmenu_get_index (erasers.get (), slices[i]) == (gint) i,
+                "spec slice shared between menus") && ok;
+    ok = check (std::strcmp (slices[i]->label, tools[i].label) == 0,
+                "spec slice label") && ok;
+  }
+
+  // A moved menu keeps its contents
+  fittsmenu::Menu moved (std::move (pens));
+  ok = check (!pens.get () && fittsmenu_get_index (moved.get (), slices[0]) == 0,
+              "contents follow a moved menu") && ok;
+  return ok;
+}
+
+/* Handlers run on clicked-signal until their connection is dropped */
+static bool
+check_clicked (void)
+{
+  fittsmenu::Menu menu;
+  int clicks = 0;
+  bool ok = true;
+
+  menu.set_contents<tools> ();
+  {
+    fittsmenu::Connection connection = menu.on_clicked ([&clicks] { clicks++; });
+    g_signal_emit_by_name (menu.get (), "clicked-signal");
+    ok = check (clicks == 1, "clicked handler runs") && ok;
+  }
+  g_signal_emit_by_name (menu.get (), "clicked-signal");
+  ok = check (clicks == 1, "clicked handler goes with its connection") && ok;
+
+  // Released handlers stay for the life of the menu
+  menu.on_clicked ([&clicks] { clicks++; }).release ();
+  g_signal_emit_by_name (menu.get (), "clicked-signal");
+  ok = check (clicks == 2, "released clicked handler stays") && ok;
+  return ok;
+}
+
+/* A menu made in C and handed over keeps its popup window when the handle
+ * goes, only menus the handle made take theirs with them */
+static bool
+check_adopted (void)
+{
+  Fittsmenu *widget;
+  bool ok = true;
+
+  widget = FITTSMENU (fittsmenu_new ());
+  g_object_ref_sink (widget);
+  fittsmenu_set_transition_time (widget, 0);
+  fittsmenu_popup (widget, 0);
+  fittsmenu_popdown (widget);
+  while (g_main_context_iteration (NULL, FALSE));
+
+  // The handle takes over a reference of its own, ours keeps the widget to
+  // look at
+  g_object_ref (widget);
+  {
+    fittsmenu::Menu adopted (widget);
+  }
+  ok = check (widget->toplevel != NULL, "adopted menu's popup window kept") && ok;
+
+  gtk_widget_destroy (widget->toplevel);
+  g_object_unref (widget);
+
+  {
+    fittsmenu::Menu made;
+    fittsmenu_set_transition_time (made.get (), 0);
+    made.popup ();
+    made.popdown ();
+    while (g_main_context_iteration (NULL, FALSE));
+    widget = made.get ();
+    g_object_add_weak_pointer (G_OBJECT (widget), (gpointer *) &widget);
+  }
+  ok = check (widget == NULL, "made menu goes with its popup window") && ok;
+  return ok;
+}
+
+static bool
+check (bool ok, const char *what)
+{
+  if (!ok)
+    g_printerr ("%s failed\n", what);
+  return ok;
+}
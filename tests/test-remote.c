@@ -0,0 +1,228 @@
+/*******************************************************************************
+ * Fittsmenu remote drawing test
+ *
+ *   Draws the same frames into an X pixmap with the core in normal and in
+ *   remote mode and counts the bytes sent to the X server for each frame.
+ *   Remote mode keeps icons and sprites on the server, so it has to send
+ *   less. Runs on $DISPLAY, or on an Xvfb of its own when there is none,
+ *   and is skipped when neither is available.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <cairo.h>
+#include <cairo-xlib.h>
+#include <X11/Xlib.h>
+
+#include "fittsmenu-core.h"
+
+#define REMOTE_SLICES 12
+
+/* Frames drawn before counting, until every sprite and raster exists */
+#define REMOTE_WARM_FRAMES 100
+
+/* Exit status automake takes as a skipped test */
+#define EXIT_SKIP 77
+
+static const gchar *icons[] =
+{
+  "icon_cursor.svg", "icon_nodes.svg", "icon_rectangle.svg", "icon_ellipse.svg",
+  "icon_star.svg", "icon_spiral.svg", "icon_freehand.svg", "icon_curves.svg",
+  "icon_calig.svg", "icon_text.svg", "icon_gradient.svg", "icon_droplet.svg"
+};
+
+static gint frames = 200;
+
+static Display* open_display (GPid *xvfb);
+static gdouble bytes_per_frame (Display *display, gboolean remote, guint sprite_angles);
+static gint64 written_bytes (void);
+
+int
+main (int argc, char **argv)
+{
+  GOptionEntry entries[] =
+  {
+    { "frames", 'f', 0, G_OPTION_ARG_INT, &frames, "Frames to count", "N" },
+    { NULL }
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  Display *display;
+  GPid xvfb = 0;
+  gdouble normal, remote;
+  guint sprite_angles[] = { 0, 36 };
+  gboolean ok = TRUE;
+  guint i;
+
+  context = g_option_context_new ("- count what a Fittsmenu sends the X server");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (written_bytes () < 0) {
+    g_print ("# no /proc/self/io, skipped\n");
+    return EXIT_SKIP;
+  }
+  display = open_display (&xvfb);
+  if (!display) {
+    g_print ("# no display and no Xvfb, skipped\n");
+    return EXIT_SKIP;
+  }
+
+  // With and without sprites, the two ways a frame is put together
+  for (i = 0; i < G_N_ELEMENTS (sprite_angles); i++) {
+    normal = bytes_per_frame (display, FALSE, sprite_angles[i]);
+    remote = bytes_per_frame (display, TRUE, sprite_angles[i]);
+    g_print ("# %u sprite angles: normal %.0f, remote %.0f bytes per frame\n",
+             sprite_angles[i], normal, remote);
+    if (remote >= normal) {
+      g_printerr ("remote mode sent no less than normal mode with %u sprite angles\n",
+                  sprite_angles[i]);
+      ok = FALSE;
+    }
+  }
+
+  XCloseDisplay (display);
+  if (xvfb) {
+    kill (xvfb, SIGTERM);
+    g_spawn_close_pid (xvfb);
+  }
+  return ok ? 0 : 1;
+}
+
+/* $DISPLAY, or else an Xvfb started here, which prints its display number
+ * on the pipe once it takes connections */
+static Display*
+open_display (GPid *xvfb)
+{
+  Display *display;
+  gchar *argv[] = { "Xvfb", "-displayfd", NULL, "-screen", "0", "640x480x24",
+                    "-nolisten", "tcp", NULL };
+  gchar buffer[32], *name;
+  gint fds[2];
+  gssize length;
+
+  display = XOpenDisplay (NULL);
+  if (display)
+    return display;
+
+  if (pipe (fds) < 0)
+    return NULL;
+  argv[2] = g_strdup_printf ("%d", fds[1]);
+  if (!g_spawn_async (NULL, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_LEAVE_DESCRIPTORS_OPEN |
+                      G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, xvfb, NULL))
+    *xvfb = 0;
+  g_free (argv[2]);
+  close (fds[1]);
+
+  length = *xvfb ? read (fds[0], buffer, sizeof (buffer) - 1) : 0;
+  close (fds[0]);
+  if (length <= 0)
+    return NULL;
+
+  buffer[length] = '\0';
+  name = g_strdup_printf (":%d", atoi (buffer));
+  display = XOpenDisplay (name);
+  g_free (name);
+  return display;
+}
+
+/* Draw frames into a pixmap as the pointer circles the ring and it turns
+ * towards it, returning what went to the server for each once warmed up */
+static gdouble
+bytes_per_frame (Display *display, gboolean remote, guint sprite_angles)
+{
+  FittsmenuCore *core;
+  fittsmenu_slice *slice;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  Pixmap pixmap;
+  gint64 time, before, after;
+  gdouble angle;
+  gchar *label, *path;
+  gint radius, size, f, k;
+
+  core = fittsmenu_core_new ();
+  fittsmenu_core_set_remote (core, remote);
+  fittsmenu_core_set_sprite_cache (core, sprite_angles, 0);
+  fittsmenu_core_set_animation (core, FITTSMENU_ANIM_CROTATE);
+  fittsmenu_core_set_frame_interval (core, 0);
+  for (k = 0; k < REMOTE_SLICES; k++) {
+    label = g_strdup_printf ("Slice %d", k);
+    path = g_build_filename (EXAMPLES_DATA_PATH, icons[k], NULL);
+    slice = fittsmenu_slice_new (label, path);
+    fittsmenu_core_append (core, slice);
+    g_free (label);
+    g_free (path);
+  }
+
+  radius = fittsmenu_core_get_menu_radius (core);
+  size = radius * 2;
+  pixmap = XCreatePixmap (display, DefaultRootWindow (display), size, size,
+                          DefaultDepth (display, DefaultScreen (display)));
+  surface = cairo_xlib_surface_create (display, pixmap,
+                                       DefaultVisual (display, DefaultScreen (display)),
+                                       size, size);
+  fittsmenu_core_reset (core);
+  fittsmenu_core_pointer_enter (core);
+
+  before = 0;
+  time = 0;
+  for (f = 0; f < REMOTE_WARM_FRAMES + frames; f++) {
+    if (f == REMOTE_WARM_FRAMES)
+      before = written_bytes ();
+
+    angle = f * 0.05;
+    fittsmenu_core_pointer_motion (core, radius + cos (angle) * radius * 0.7,
+                                   radius + sin (angle) * radius * 0.7);
+    time += G_USEC_PER_SEC / 60;
+    fittsmenu_core_advance (core, time);
+
+    cr = cairo_create (surface);
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+    fittsmenu_core_render (core, cr);
+    cairo_destroy (cr);
+    cairo_surface_flush (surface);
+    XSync (display, False);
+  }
+  after = written_bytes ();
+
+  // Sprites and rasters on the server go before the pixmap they were
+  // drawn for
+  fittsmenu_core_free (core);
+  cairo_surface_destroy (surface);
+  XFreePixmap (display, pixmap);
+  XSync (display, False);
+
+  return (gdouble) (after - before) / frames;
+}
+
+/* Bytes this process has written, to the X connection while drawing.
+ * -1 if the kernel doesn't say. */
+static gint64
+written_bytes (void)
+{
+  gchar *contents = NULL, *line;
+  gint64 bytes = -1;
+
+  if (!g_file_get_contents ("/proc/self/io", &contents, NULL, NULL))
+    return -1;
+  line = strstr (contents, "wchar:");
+  if (line)
+    bytes = g_ascii_strtoll (line + 6, NULL, 10);
+  g_free (contents);
+  return bytes;
+}
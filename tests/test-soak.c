@@ -0,0 +1,308 @@
+/*******************************************************************************
+ * Fittsmenu soak test
+ *
+ *   Draws the menu frame after frame into an image surface while the
+ *   pointer circles it, badges change and contents are republished, then
+ *   pops it up and down over and over. Memory held once everything has
+ *   warmed up must not grow by the end, and every raster must be given back
+ *   when the menus go.
+ *
+ *   The widget cycles only run when a display can be opened, the core ones
+ *   always do. Leaks too small to show past the slack are left to the leak
+ *   checkers, make check-valgrind runs this under valgrind and configuring
+ *   with CFLAGS=-fsanitize=address runs it under ASan.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib.h>
+#include <cairo.h>
+#include <gtk/gtk.h>
+
+#include "fittsmenu.h"
+
+#define SOAK_SLICES 12
+
+/* Allocators keep some of what they are given back, growth below this is
+ * not counted */
+#define SOAK_RSS_SLACK (512 * 1024)
+
+static const gchar *icons[] =
+{
+  "icon_cursor.svg", "icon_nodes.svg", "icon_rectangle.svg", "icon_ellipse.svg",
+  "icon_star.svg", "icon_spiral.svg", "icon_freehand.svg", "icon_curves.svg",
+  "icon_calig.svg", "icon_text.svg", "icon_gradient.svg", "icon_droplet.svg"
+};
+
+static gint frames = 100000;
+static gint cycles = 10000;
+static gboolean skip_rss = FALSE;
+
+static gboolean soak_frames (void);
+static gboolean soak_cycles (void);
+static gboolean soak_widget (void);
+static void soak_fill (fittsmenu_slice **slices);
+static gsize resident_bytes (void);
+static gboolean check_growth (const gchar *what, gsize before, gsize after, gsize slack);
+
+int
+main (int argc, char **argv)
+{
+  GOptionEntry entries[] =
+  {
+    { "frames", 'f', 0, G_OPTION_ARG_INT, &frames, "Frames to draw", "N" },
+    { "cycles", 'c', 0, G_OPTION_ARG_INT, &cycles, "Popup and popdown cycles", "N" },
+    { "skip-rss", 0, 0, G_OPTION_ARG_NONE, &skip_rss,
+      "Leave leaks to the leak checker, its own memory grows", NULL },
+    { NULL }
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  gboolean ok;
+
+  context = g_option_context_new ("- draw and pop up a Fittsmenu until it leaks");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (g_getenv ("FITTSMENU_SOAK_SKIP_RSS"))
+    skip_rss = TRUE;
+#if defined(__SANITIZE_ADDRESS__)
+  // ASan's quarantine holds on to freed memory
+  skip_rss = TRUE;
+#endif
+
+  ok = soak_frames ();
+  ok = soak_cycles () && ok;
+  if (gtk_init_check (&argc, &argv))
+    ok = soak_widget () && ok;
+  else
+    g_print ("# no display, widget cycles skipped\n");
+
+  if (!check_growth ("raster bytes after every menu went", 0,
+                     fittsmenu_get_total_raster_bytes (), 0))
+    ok = FALSE;
+
+  return ok ? 0 : 1;
+}
+
+/* One menu drawn frames times, the pointer going round a little over once
+ * a second */
+static gboolean
+soak_frames (void)
+{
+  FittsmenuCore *core;
+  FittsmenuSnapshot *snapshot;
+  fittsmenu_slice *slices[SOAK_SLICES];
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gint64 time;
+  gsize rss = 0, rasters = 0;
+  gdouble angle;
+  gchar *badge;
+  gint x, y, width, height;
+  gint radius, warm, f, k;
+  gboolean ok = TRUE;
+
+  core = fittsmenu_core_new ();
+  fittsmenu_core_set_animation (core, FITTSMENU_ANIM_CROTATE);
+  fittsmenu_core_set_frame_interval (core, 0);
+  soak_fill (slices);
+  for (k = 0; k < SOAK_SLICES; k++)
+    fittsmenu_core_append (core, fittsmenu_slice_ref (slices[k]));
+
+  radius = fittsmenu_core_get_menu_radius (core);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, radius * 2, radius * 2);
+  fittsmenu_core_reset (core);
+  fittsmenu_core_pointer_enter (core);
+
+  warm = frames / 10;
+  time = 0;
+  for (f = 0; f < frames; f++) {
+    if (f == warm) {
+      rss = resident_bytes ();
+      rasters = fittsmenu_get_total_raster_bytes ();
+    }
+
+    angle = f * 0.1;
+    fittsmenu_core_pointer_motion (core, radius + cos (angle) * radius * 0.7,
+                                   radius + sin (angle) * radius * 0.7);
+
+    // Changes in place damage a sector, the whole contents come round now
+    // and then
+    if (f % 50 == 0) {
+      badge = g_strdup_printf ("%d", f / 50 % 100);
+      fittsmenu_slice_set_badge (slices[f / 50 % SOAK_SLICES], badge);
+      fittsmenu_slice_set_progress (slices[(f / 50 + 1) % SOAK_SLICES], (f % 1000) / 1000.0);
+      g_free (badge);
+      fittsmenu_core_take_damage (core, &x, &y, &width, &height);
+    }
+    if (f % 1000 == 0) {
+      snapshot = fittsmenu_snapshot_new (slices, SOAK_SLICES - f / 1000 % 2);
+      fittsmenu_core_publish (core, snapshot);
+      fittsmenu_snapshot_unref (snapshot);
+    }
+
+    time += G_USEC_PER_SEC / 60;
+    fittsmenu_core_advance (core, time);
+    cr = cairo_create (surface);
+    fittsmenu_core_render (core, cr);
+    cairo_destroy (cr);
+  }
+
+  if (!skip_rss && !check_growth ("resident bytes over frames", rss, resident_bytes (),
+                                  SOAK_RSS_SLACK))
+    ok = FALSE;
+  if (!check_growth ("raster bytes over frames", rasters,
+                     fittsmenu_get_total_raster_bytes (), 0))
+    ok = FALSE;
+
+  cairo_surface_destroy (surface);
+  fittsmenu_core_free (core);
+  for (k = 0; k < SOAK_SLICES; k++)
+    fittsmenu_slice_unref (slices[k]);
+  return ok;
+}
+
+/* A popup and popdown of the core, drawn a few times and then picked from
+ * or left, each cycle */
+static gboolean
+soak_cycles (void)
+{
+  FittsmenuCore *core;
+  fittsmenu_slice *slices[SOAK_SLICES];
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gint64 time;
+  gsize rss = 0;
+  gdouble angle;
+  gint radius, warm, c, f, k;
+  gboolean ok = TRUE;
+
+  core = fittsmenu_core_new ();
+  soak_fill (slices);
+  for (k = 0; k < SOAK_SLICES; k++)
+    fittsmenu_core_append (core, fittsmenu_slice_ref (slices[k]));
+
+  radius = fittsmenu_core_get_menu_radius (core);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, radius * 2, radius * 2);
+
+  warm = cycles / 10;
+  time = 0;
+  for (c = 0; c < cycles; c++) {
+    if (c == warm)
+      rss = resident_bytes ();
+
+    fittsmenu_core_sync (core);
+    fittsmenu_core_reset (core);
+    fittsmenu_core_pointer_enter (core);
+    angle = c * 0.7;
+    for (f = 0; f < 4; f++) {
+      fittsmenu_core_pointer_motion (core, radius + cos (angle) * radius * (0.3 + f * 0.15),
+                                     radius + sin (angle) * radius * (0.3 + f * 0.15));
+      time += G_USEC_PER_SEC / 60;
+      fittsmenu_core_advance (core, time);
+      cr = cairo_create (surface);
+      fittsmenu_core_render (core, cr);
+      cairo_destroy (cr);
+    }
+    if (c % 2)
+      fittsmenu_core_activate (core);
+    else
+      fittsmenu_core_pointer_leave (core);
+  }
+
+  if (!skip_rss && !check_growth ("resident bytes over core cycles", rss, resident_bytes (),
+                                  SOAK_RSS_SLACK))
+    ok = FALSE;
+
+  cairo_surface_destroy (surface);
+  fittsmenu_core_free (core);
+  for (k = 0; k < SOAK_SLICES; k++)
+    fittsmenu_slice_unref (slices[k]);
+  return ok;
+}
+
+/* The same through the widget, each cycle shows the popup window, lets it
+ * draw and takes it down again */
+static gboolean
+soak_widget (void)
+{
+  Fittsmenu *fittsmenu;
+  fittsmenu_slice *slices[SOAK_SLICES];
+  gsize rss = 0;
+  gint warm, c, k;
+  gboolean ok = TRUE;
+
+  fittsmenu = fittsmenu_new ();
+  g_object_ref_sink (fittsmenu);
+  fittsmenu_set_transition_time (fittsmenu, 0);
+  soak_fill (slices);
+  for (k = 0; k < SOAK_SLICES; k++)
+    fittsmenu_append (fittsmenu, slices[k]);
+
+  warm = cycles / 10;
+  for (c = 0; c < cycles; c++) {
+    if (c == warm)
+      rss = resident_bytes ();
+
+    fittsmenu_popup (fittsmenu, 0);
+    while (g_main_context_iteration (NULL, FALSE));
+    fittsmenu_popdown (fittsmenu);
+    while (g_main_context_iteration (NULL, FALSE));
+  }
+
+  if (!skip_rss && !check_growth ("resident bytes over widget cycles", rss, resident_bytes (),
+                                  SOAK_RSS_SLACK))
+    ok = FALSE;
+
+  gtk_widget_destroy (GTK_WIDGET (fittsmenu));
+  g_object_unref (fittsmenu);
+  while (g_main_context_iteration (NULL, FALSE));
+  return ok;
+}
+
+/* The example icons, the caller owns the slices */
+static void
+soak_fill (fittsmenu_slice **slices)
+{
+  gchar *label, *path;
+  gint k;
+
+  for (k = 0; k < SOAK_SLICES; k++) {
+    label = g_strdup_printf ("Slice %d", k);
+    path = g_build_filename (EXAMPLES_DATA_PATH, icons[k], NULL);
+    slices[k] = fittsmenu_slice_new (label, path);
+    g_free (label);
+    g_free (path);
+  }
+}
+
+static gsize
+resident_bytes (void)
+{
+  gchar *contents = NULL;
+  gulong size = 0, resident = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    sscanf (contents, "%lu %lu", &size, &resident);
+  g_free (contents);
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+static gboolean
+check_growth (const gchar *what, gsize before, gsize after, gsize slack)
+{
+  g_print ("# %s: %" G_GSIZE_FORMAT " to %" G_GSIZE_FORMAT "\n", what, before, after);
+  if (after <= before + slack)
+    return TRUE;
+
+  g_printerr ("%s grew by %" G_GSIZE_FORMAT "\n", what, after - before);
+  return FALSE;
+}